@@ -293,6 +293,24 @@ typedef struct _WsManTransport {} WsManTransport;
     return wsman_transport_get_timeout((WsManClient *)$self);
   }
 
+#if defined(SWIGRUBY)
+  %rename("compression=") set_compression(int level);
+#endif
+  /*
+   * Set the zlib level (1-9) for gzip Content-Encoding, 0 disables
+   */
+  void set_compression(int level) {
+    wsman_transport_set_compression((WsManClient *)$self, level);
+  }
+  /*
+   * Get the compression level
+   * call-seq:
+   *   transport.compression -> Integer
+   */
+  int compression() {
+    return wsman_transport_get_compression((WsManClient *)$self);
+  }
+
 #if defined(SWIGRUBY)
   %rename("verify_peer=") set_verify_peer( VALUE rvalue );
  /*
@@ -91,6 +91,11 @@ typedef struct {
 	WsmanKnownStatusCode http_code;
 }CimxmlMessage;
 
+/* called whenever a CIM_ClassIndication is delivered to a subscription */
+typedef void (*CimClassChangeCallback) (void);
+
+void cimxml_set_class_change_callback(CimClassChangeCallback callback);
+
 CimxmlMessage *cimxml_message_new(void);
 void cimxml_message_destroy(CimxmlMessage *msg);
 void CIM_Indication_call(cimxml_context *cntx, CimxmlMessage *message, void *opaqueData);
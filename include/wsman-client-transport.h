@@ -104,6 +104,9 @@ char *wsman_transport_get_last_error_string(WS_LASTERR_Code err);
 extern void          wsman_transport_set_timeout(WsManClient *cl, unsigned long timeout);
 extern unsigned long wsman_transport_get_timeout(WsManClient *cl);
 
+extern void wsman_transport_set_compression(WsManClient *cl, int level);
+extern int  wsman_transport_get_compression(WsManClient *cl);
+
 extern void wsman_transport_set_verify_peer(WsManClient *cl, unsigned int value);
 extern unsigned int  wsman_transport_get_verify_peer(WsManClient *cl);
 
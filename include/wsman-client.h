@@ -120,6 +120,8 @@ extern "C" {
 		char *content_encoding;
 		char *cim_ns;
 		unsigned long transport_timeout;
+		int compression;	/* zlib level for Content-Encoding, 0 = off */
+		int compress_requests;	/* server answered with a compressed response */
 		char * user_agent;
 		FILE *dumpfile;
 		long initialized;
@@ -0,0 +1,113 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+/**
+ * HTTP Content-Encoding support (gzip and deflate) shared by the
+ * server and the client transport.
+ */
+
+#ifndef WSMAN_COMPRESS_H_
+#define WSMAN_COMPRESS_H_
+
+#include "u/buf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif				/* __cplusplus */
+
+typedef enum {
+	WSMAN_CODING_IDENTITY = 0,
+	WSMAN_CODING_GZIP,
+	WSMAN_CODING_DEFLATE,
+	WSMAN_CODING_UNSUPPORTED
+} WsmanContentCoding;
+
+typedef struct _WsmanInflater WsmanInflater;
+
+/* Bodies smaller than this are not worth compressing */
+#define WSMAN_COMPRESS_MIN_SIZE 1024
+
+/*
+ * Non zero if the library was built with zlib.
+ */
+int wsman_compress_available(void);
+
+/*
+ * Map a Content-Encoding header value to a coding. NULL or empty
+ * means identity.
+ */
+WsmanContentCoding wsman_content_coding(const char *value);
+
+/*
+ * Pick the preferred coding out of an Accept-Encoding header value,
+ * honouring q=0. Returns identity if nothing usable is offered or
+ * zlib is not available.
+ */
+WsmanContentCoding wsman_accept_coding(const char *value);
+
+/*
+ * Token to put in a Content-Encoding header, NULL for identity.
+ */
+const char *wsman_content_coding_name(WsmanContentCoding coding);
+
+/*
+ * Compress len bytes at data into out (which is cleared first) with
+ * the given zlib level. Returns 0 on success.
+ */
+int wsman_deflate(WsmanContentCoding coding, int level,
+		  const char *data, size_t len, u_buf_t * out);
+
+/*
+ * Streaming decoder for request or response bodies. Inflated data is
+ * appended to the output buffer; more than max_len bytes of output
+ * (0 for no limit) is an error.
+ */
+WsmanInflater *wsman_inflater_new(WsmanContentCoding coding,
+				  size_t max_len);
+
+/*
+ * Feed the next chunk of encoded input. Returns 0 on success, -1 on a
+ * corrupt stream and -2 if the output limit was exceeded.
+ */
+int wsman_inflater_update(WsmanInflater * z, const void *data,
+			  size_t len, u_buf_t * out);
+
+/*
+ * Non zero once the end of the compressed stream has been seen.
+ */
+int wsman_inflater_finished(WsmanInflater * z);
+
+void wsman_inflater_free(WsmanInflater * z);
+
+#ifdef __cplusplus
+}
+#endif				/* __cplusplus */
+
+#endif				/* WSMAN_COMPRESS_H_ */
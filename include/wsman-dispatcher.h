@@ -71,6 +71,7 @@ struct __op_t {
 	//not deleted on destroy
 	WsmanMessage *data;
 	list_t *processed_headers;
+	struct __WsmanHeaderIndex *headers; // of in_doc
 };
 typedef struct __op_t op_t;
 
@@ -80,6 +81,10 @@ void dispatch_inbound_call(SoapH soap, WsmanMessage * msg,
 
 SoapDispatchH wsman_dispatcher(WsContextH cntx, void *data, WsXmlDocH doc);
 
+void *wsman_dispatcher_routes_new(WsManDispatcherInfo *dispInfo);
+
+void wsman_dispatcher_routes_free(void *routes);
+
 void destroy_op_entry(op_t * entry);
 
 op_t *create_op_entry(SoapH soap, SoapDispatchH dispatch,
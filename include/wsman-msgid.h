@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+/**
+ * Set of recently processed WS-Addressing MessageIDs, used to reject
+ * duplicate requests.
+ */
+
+#ifndef WSMAN_MSGID_H_
+#define WSMAN_MSGID_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif				/* __cplusplus */
+
+typedef struct _WsmanMsgIdSet WsmanMsgIdSet;
+
+/* Remember MessageIDs for this many seconds */
+#define WSMAN_MSGID_WINDOW	60
+/* Upper bound on remembered MessageIDs, the oldest go first */
+#define WSMAN_MSGID_MAX		(1024 * 1024)
+
+WsmanMsgIdSet *wsman_msgid_set_new(unsigned long window,
+				   unsigned long max_ids);
+
+void wsman_msgid_set_destroy(WsmanMsgIdSet *set);
+
+/* Change the window, 0 keeps the current one */
+void wsman_msgid_set_window(WsmanMsgIdSet *set, unsigned long window);
+
+/*
+ * Returns 1 if msgid was already seen within the window. Otherwise
+ * records it and returns 0. Safe to call from several threads.
+ */
+int wsman_msgid_set_check(WsmanMsgIdSet *set, const char *msgid);
+
+/* Number of MessageIDs remembered, expired ones are dropped first */
+unsigned long wsman_msgid_set_count(WsmanMsgIdSet *set);
+
+/* Hash of a MessageID or another generated ID, FNV-1a */
+unsigned int wsman_id_hash(const char *s);
+
+#ifdef __cplusplus
+}
+#endif				/* __cplusplus */
+
+#endif				/* WSMAN_MSGID_H_ */
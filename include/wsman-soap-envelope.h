@@ -44,8 +44,34 @@
 /* special hash key to denote method args (where array elements have identical keys) */
 #define METHOD_ARGS_KEY "method_args"
 
+/**
+ * SOAP header blocks of an inbound request, located in a single pass
+ * by wsman_build_inbound_envelope(). Each slot holds the first header
+ * child of that name, the one ws_xml_get_child() would return.
+ */
+struct __WsmanHeaderIndex {
+	WsXmlNodeH header;
+	WsXmlNodeH to;
+	WsXmlNodeH action;
+	WsXmlNodeH message_id;
+	WsXmlNodeH reply_to;
+	WsXmlNodeH fault_to;
+	WsXmlNodeH resource_uri;
+	WsXmlNodeH selector_set;
+	WsXmlNodeH option_set;
+	WsXmlNodeH max_envelope_size;
+	WsXmlNodeH operation_timeout;
+	WsXmlNodeH locale;
+	WsXmlNodeH fragment_transfer;
+	/* first mustUnderstand header this service does not process */
+	WsXmlNodeH not_understood;
+};
+typedef struct __WsmanHeaderIndex WsmanHeaderIndex;
+
 int wsman_is_valid_envelope(WsmanMessage * msg, WsXmlDocH doc);
 
+WsmanHeaderIndex *wsman_get_header_index(WsXmlDocH doc);
+
 char *wsman_get_soap_header_value( WsXmlDocH doc, const char *nsUri,
 				  			const char *name);
 
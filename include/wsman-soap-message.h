@@ -74,6 +74,7 @@ typedef struct _WsmanMessage WsmanMessage;
 void wsman_set_message_flags(WsmanMessage *msg, unsigned int flag);
 
 WsmanMessage *wsman_soap_message_new(void);
+void wsman_soap_message_set_request(WsmanMessage *wsman_msg, u_buf_t *request);
 void wsman_soap_message_destroy(WsmanMessage* wsman_msg);
 
 #ifdef __cplusplus
@@ -47,6 +47,7 @@
 #include "wsman-event-pool.h"
 #include "wsman-subscription-repository.h"
 #include "wsman-xml-serializer.h"
+#include "wsman-msgid.h"
 
 #define SOAP_MAX_RESENT_COUNT       10
 #define PEDNING_EVENT_MAX_COUNT	10
@@ -103,7 +104,7 @@ struct __Soap {
 	list_t         *outboundFilterList;
 
 	list_t         *dispatchList;
-	list_t         *processedMsgIdList;
+	WsmanMsgIdSet  *processedMsgIds;
 
 	pthread_mutex_t lockSubs; //lock for Subscription Repository
 	char 			*uri_subsRepository; //URI of repository
@@ -116,9 +117,12 @@ struct __Soap {
 };
 typedef struct __Soap *SoapH;
 
+struct __WsmanHeaderIndex;
+
 struct _WsXmlDoc {
 	void           *parserDoc;
 	unsigned long   prefixIndex; // to enumerate not well known namespaces
+	struct __WsmanHeaderIndex *headers; // inbound requests only
 };
 
 
@@ -130,11 +134,13 @@ struct _WS_CONTEXT_ENTRY {
 };
 typedef struct _WS_CONTEXT_ENTRY WS_CONTEXT_ENTRY;
 
+typedef struct __WsEnumInfoTable WsEnumInfoTable;
+
 struct _WS_CONTEXT {
 	SoapH soap;
 	unsigned long enumIdleTimeout;
 	WsXmlDocH	indoc;
-	hash_t *enuminfos;
+	WsEnumInfoTable *enuminfos;	/* runtime context only */
 	hash_t *entries;
 	WsSerializerContextH serializercntx;
 	list_t         	*subscriptionMemList; //memory Repository of Subscriptions
@@ -200,6 +206,7 @@ struct __WsManDispatcherInfo {
 	int             interfaceCount;
 	int             mapCount;
 	void           *interfaces;
+	void           *routes;	/* Routing index, see wsman-dispatcher.c */
 	DispatchToEpMap map[1];
 };
 typedef struct __WsManDispatcherInfo WsManDispatcherInfo;
@@ -220,6 +227,12 @@ typedef int     (*WsEndPointPull) (WsContextH, WsEnumerateInfo *, WsmanStatus *,
 
 typedef int     (*WsEndPointRelease) (WsContextH, WsEnumerateInfo *, WsmanStatus *, void *);
 
+/* move the pending items of an enumeration to the file, 0 on success */
+typedef int     (*WsEndPointSpill) (WsEnumerateInfo *, FILE *);
+
+/* read the next batch ahead between Pulls, render it too if asked to */
+typedef void    (*WsEndPointPrefetch) (WsEnumerateInfo *, int);
+
 typedef int     (*WsEndPointPut) (WsContextH, void *, void **, WsmanStatus *, void *);
 
 typedef void   *(*WsEndPointGet) (WsContextH, WsmanStatus *, void *);
@@ -252,6 +265,9 @@ typedef int (*WsEndPointSubscriptionCancel) (WsEventThreadContextH);
 #define WSMAN_ENUMINFO_SELECTOR		  0x200000
 #define WSMAN_ENUMINFO_CIM_CONTEXT_CLEANUP 0x400000
 #define WSMAN_ENUMINFO_XPATH              0x800000
+#define WSMAN_ENUMINFO_TOTAL_UNKNOWN      0x1000000 /* totalItems only counts items read so far */
+#define WSMAN_ENUMINFO_PREFETCH           0x2000000 /* in work reading ahead */
+#define WSMAN_ENUMINFO_SPILLING           0x4000000 /* in work spilling to disk */
 
 struct __WsEnumerateInfo {
 	unsigned long flags;
@@ -273,6 +289,11 @@ struct __WsEnumerateInfo {
 	void *		aux;
 	void		*epr;
 	filter_t	*filter;
+	unsigned long	memSize; // bytes held for the pending items, set by the endpoint
+	unsigned long	memCounted; // part of memSize in the table total
+	WsEndPointSpill	spillproc; // set by the endpoint if it can spill
+	FILE		*spillFile; // pending items, once spilled
+	WsEndPointPrefetch prefetchproc; // set by the endpoint if it can read ahead
 };
 
 #define WSMAN_SUBSCRIBEINFO_UNSUBSCRIBE 0x01
@@ -374,6 +395,17 @@ SoapH ws_soap_initialize(void);
 void ws_set_context_enumIdleTimeout(WsContextH cntx,
                             unsigned long timeout);
 
+void ws_set_context_msgIdWindow(WsContextH cntx,
+                            unsigned long window);
+
+void ws_set_context_enumMemoryLimits(WsContextH cntx,
+                            unsigned long context_limit,
+                            unsigned long total_limit,
+                            const char *spill_dir);
+
+void ws_set_context_enumPrefetch(WsContextH cntx,
+                            int threads, int render);
+
 void soap_destroy(SoapH soap);
 
 SoapH ws_context_get_runtime(WsContextH hCntx);
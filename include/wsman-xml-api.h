@@ -41,6 +41,7 @@ extern "C" {
 
 #include <stdio.h>
 
+#include "u/buf.h"
 #include "wsman-types.h"
 
 
@@ -109,6 +110,10 @@ void ws_xml_dump_doc(FILE * f, WsXmlDocH doc);
 void ws_xml_dump_memory_enc(WsXmlDocH doc, char **buf, int *ptrSize,
 			    const char *encoding);
 
+/* same, appended to buf */
+int ws_xml_dump_memory_buf(WsXmlDocH doc, u_buf_t *buf,
+			   const char *encoding);
+
 	// WSXmlDoc handling
 
 WsXmlNodeH ws_xml_get_doc_root(WsXmlDocH doc);
@@ -102,6 +102,13 @@ void xml_parser_free_memory(void *ptr);
 void xml_parser_doc_to_memory(WsXmlDocH doc, char **buf,
 			      int *ptrSize, const char *encoding);
 
+int xml_parser_doc_to_buf(WsXmlDocH doc, u_buf_t *buf,
+			  const char *encoding);
+
+long xml_parser_doc_size(WsXmlDocH doc, const char *encoding);
+
+long xml_parser_node_size(WsXmlNodeH node, const char *encoding);
+
 void xml_parser_doc_dump(FILE * f, WsXmlDocH doc);
 
 void xml_parser_doc_dump_memory(WsXmlDocH doc, char **buf, int *ptrSize);
@@ -117,6 +117,26 @@ void ws_xml_unlink_node(WsXmlNodeH node);
 //to check if the size of envelop exceeds a maxium size
 int check_envelope_size(WsXmlDocH doc, unsigned int size, const char *charset);
 
+/*
+ * Running serialized size of a document being built, so checking
+ * whether one more element fits costs the size of that element rather
+ * than a dump of the whole document.
+ */
+struct __WsXmlSize {
+	WsXmlDocH doc;
+	const char *charset;
+	unsigned long size;
+	int nscount;	/* namespaces declared on the root when last measured */
+};
+typedef struct __WsXmlSize WsXmlSize;
+
+unsigned long ws_xml_size_init(WsXmlSize *s, WsXmlDocH doc,
+			       const char *charset);
+
+unsigned long ws_xml_size_add(WsXmlSize *s, WsXmlNodeH node);
+
+unsigned long ws_xml_size_remove(WsXmlSize *s, WsXmlNodeH node);
+
 /** @} */
 
 #endif				/*XML_API_GENERIC_H_ */
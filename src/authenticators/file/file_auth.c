@@ -44,6 +44,7 @@
 #endif
 #include "u/libu.h"
 #include <stdio.h>
+#include <pthread.h>
 
 
 int initialize(void *arg);
@@ -51,6 +52,9 @@ int authorize(char *username, const char *password);
 
 static char *filename = NULL;
 
+/* crypt() returns a static buffer, the I/O threads call us concurrently */
+static pthread_mutex_t crypt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 int initialize(void *arg) {
     FILE *fp;
 
@@ -100,9 +104,11 @@ authorize(char *username, const char *password)
                     continue;       /* Ignore malformed lines */
                 debug( "user: %s,  passwd: XXXX", u);
                 if (!strcmp(username, u)) {
+                        pthread_mutex_lock(&crypt_mutex);
                         newpw = crypt(password, passwd);
                         debug( "user: %s,  passwd: XXXXX", u );
-                        authorized = ( strcmp (newpw, passwd) == 0 );
+                        authorized = ( newpw && strcmp (newpw, passwd) == 0 );
+                        pthread_mutex_unlock(&crypt_mutex);
                     break;
                 }
        }
@@ -0,0 +1,41 @@
+#ifdef HAVE_CONFIG_H
+#include <wsman_config.h>
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <u/libu.h>
+#include "wsman-msgid.h"
+
+int facility = LOG_DAEMON;
+
+
+int
+main(int argc, char *argv[])
+{
+    WsmanMsgIdSet *set = wsman_msgid_set_new(1, 64);
+    char id[64];
+    int i, failed = 0;
+
+    for (i = 0; i < 1000; i++) {
+        snprintf(id, sizeof(id), "uuid:%08x-0000-0000-0000-000000000000", i);
+        if (wsman_msgid_set_check(set, id))
+            failed++;
+    }
+    /* Only the newest are kept */
+    if (wsman_msgid_set_count(set) > 64)
+        failed++;
+    if (!wsman_msgid_set_check(set, id))
+        failed++;
+
+    /* They expire after the window */
+    sleep(2);
+    if (wsman_msgid_set_check(set, id))
+        failed++;
+    if (wsman_msgid_set_count(set) != 1)
+        failed++;
+
+    wsman_msgid_set_destroy(set);
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed != 0;
+}
@@ -122,6 +122,14 @@ char * get_cim_indication_namespace(WsSubscribeInfo *subsInfo, char *classname)
 	return NULL;
 }
 
+static CimClassChangeCallback class_change_callback = NULL;
+
+void
+cimxml_set_class_change_callback(CimClassChangeCallback callback)
+{
+	class_change_callback = callback;
+}
+
 static WsNotificationInfoH
 create_notification_entity(WsSubscribeInfo *subsInfo, WsXmlNodeH node)
 {
@@ -151,6 +159,14 @@ create_notification_entity(WsSubscribeInfo *subsInfo, WsXmlNodeH node)
 	WsXmlAttrH attr = ws_xml_find_node_attr(instance, NULL, CIMXML_CLASSNAME);
 	if (attr) {
 		classname = ws_xml_get_attr_value(attr);
+		/* CIM_ClassCreation, CIM_ClassDeletion, CIM_ClassModification */
+		if (class_change_callback && classname &&
+		    (!strcmp(classname, "CIM_ClassCreation") ||
+		     !strcmp(classname, "CIM_ClassDeletion") ||
+		     !strcmp(classname, "CIM_ClassModification"))) {
+			debug("class indication: %s", classname);
+			class_change_callback();
+		}
 		class_namespace = get_cim_indication_namespace(subsInfo, classname);
 		notificationinfo->EventAction = u_strdup_printf("%s/%s", class_namespace, classname);
 	}
@@ -208,6 +208,23 @@ void wsman_transport_set_timeout(WsManClient * cl, unsigned long arg)
 	cl->transport_timeout = arg;
 }
 
+int wsman_transport_get_compression(WsManClient * cl)
+{
+	return cl->compression;
+}
+
+/*
+ * Ask for gzip/deflate compressed responses. Requests are compressed with
+ * the given zlib level too, once the server has shown it understands
+ * Content-Encoding by sending a compressed response. 0 disables.
+ */
+void wsman_transport_set_compression(WsManClient * cl, int level)
+{
+	cl->compression = level;
+	if (level <= 0)
+		cl->compress_requests = 0;
+}
+
 
 char *wsman_transport_get_auth_method(WsManClient * cl)
 {
@@ -1885,6 +1885,8 @@ wsmc_create(const char *hostname,
 	wsc->data.auth_set = 0;
 	wsc->initialized = 0;
 	wsc->transport_timeout = 0;
+	wsc->compression = 0;
+	wsc->compress_requests = 0;
 	wsc->content_encoding = u_strdup("UTF-8");
 #ifdef _WIN32
 	wsc->session_handle = 0;
@@ -0,0 +1,326 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <wsman_config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "u/libu.h"
+#include "wsman-compress.h"
+
+#define CODING_CHUNK 16384
+
+struct _WsmanInflater {
+#ifdef HAVE_ZLIB
+	z_stream strm;
+#endif
+	size_t max_len;
+	int finished;
+};
+
+
+/*
+ * Compare the token at s (up to len chars) case insensitively.
+ */
+static int
+token_is(const char *s, size_t len, const char *token)
+{
+	return strlen(token) == len && strncasecmp(s, token, len) == 0;
+}
+
+static WsmanContentCoding
+coding_from_token(const char *s, size_t len)
+{
+	if (len == 0 || token_is(s, len, "identity"))
+		return WSMAN_CODING_IDENTITY;
+	if (token_is(s, len, "gzip") || token_is(s, len, "x-gzip"))
+		return WSMAN_CODING_GZIP;
+	if (token_is(s, len, "deflate"))
+		return WSMAN_CODING_DEFLATE;
+	return WSMAN_CODING_UNSUPPORTED;
+}
+
+int
+wsman_compress_available(void)
+{
+#ifdef HAVE_ZLIB
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+WsmanContentCoding
+wsman_content_coding(const char *value)
+{
+	const char *end;
+
+	if (value == NULL)
+		return WSMAN_CODING_IDENTITY;
+	while (isspace((unsigned char) *value))
+		value++;
+	end = value + strlen(value);
+	while (end > value && isspace((unsigned char) end[-1]))
+		end--;
+	/* Stacked codings ("gzip, deflate") are not supported */
+	if (memchr(value, ',', end - value))
+		return WSMAN_CODING_UNSUPPORTED;
+	return coding_from_token(value, end - value);
+}
+
+WsmanContentCoding
+wsman_accept_coding(const char *value)
+{
+	WsmanContentCoding best = WSMAN_CODING_IDENTITY;
+	double best_q = 0;
+	const char *p = value;
+
+	if (value == NULL || !wsman_compress_available())
+		return WSMAN_CODING_IDENTITY;
+
+	while (*p) {
+		const char *tok, *params;
+		size_t toklen;
+		double q = 1;
+		WsmanContentCoding c;
+
+		while (*p == ',' || isspace((unsigned char) *p))
+			p++;
+		tok = p;
+		while (*p && *p != ',' && *p != ';' &&
+		       !isspace((unsigned char) *p))
+			p++;
+		toklen = p - tok;
+		params = p;
+		while (*p && *p != ',')
+			p++;
+		for (; params < p; params++) {
+			if ((*params == 'q' || *params == 'Q') &&
+			    params[1] == '=') {
+				q = atof(params + 2);
+				break;
+			}
+		}
+		if (toklen == 0 || q <= 0)
+			continue;
+		c = coding_from_token(tok, toklen);
+		if (token_is(tok, toklen, "*"))
+			c = WSMAN_CODING_GZIP;
+		if (c == WSMAN_CODING_IDENTITY || c == WSMAN_CODING_UNSUPPORTED)
+			continue;
+		/* Prefer gzip on ties, it is what most clients expect */
+		if (q > best_q || (q == best_q && c == WSMAN_CODING_GZIP)) {
+			best = c;
+			best_q = q;
+		}
+	}
+	return best;
+}
+
+const char *
+wsman_content_coding_name(WsmanContentCoding coding)
+{
+	switch (coding) {
+	case WSMAN_CODING_GZIP:
+		return "gzip";
+	case WSMAN_CODING_DEFLATE:
+		return "deflate";
+	default:
+		return NULL;
+	}
+}
+
+#ifdef HAVE_ZLIB
+
+/*
+ * gzip gets the gzip wrapper, deflate the zlib one (RFC 2616 3.5).
+ */
+static int
+window_bits(WsmanContentCoding coding)
+{
+	return coding == WSMAN_CODING_GZIP ? MAX_WBITS + 16 : MAX_WBITS;
+}
+
+int
+wsman_deflate(WsmanContentCoding coding, int level,
+	      const char *data, size_t len, u_buf_t * out)
+{
+	z_stream strm;
+	size_t bound;
+	int rc;
+
+	if (coding != WSMAN_CODING_GZIP && coding != WSMAN_CODING_DEFLATE)
+		return -1;
+	if (level < Z_BEST_SPEED || level > Z_BEST_COMPRESSION)
+		level = Z_DEFAULT_COMPRESSION;
+
+	memset(&strm, 0, sizeof(strm));
+	if (deflateInit2(&strm, level, Z_DEFLATED, window_bits(coding),
+			 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+
+	/* deflateBound() does not account for the gzip wrapper */
+	bound = deflateBound(&strm, len) + 18;
+	u_buf_clear(out);
+	if (u_buf_reserve(out, bound)) {
+		deflateEnd(&strm);
+		return -1;
+	}
+	strm.next_in = (Bytef *) data;
+	strm.avail_in = len;
+	strm.next_out = (Bytef *) u_buf_ptr(out);
+	strm.avail_out = bound;
+	rc = deflate(&strm, Z_FINISH);
+	if (rc == Z_STREAM_END)
+		u_buf_set_len(out, strm.total_out);
+	deflateEnd(&strm);
+	return rc == Z_STREAM_END ? 0 : -1;
+}
+
+WsmanInflater *
+wsman_inflater_new(WsmanContentCoding coding, size_t max_len)
+{
+	WsmanInflater *z;
+
+	if (coding != WSMAN_CODING_GZIP && coding != WSMAN_CODING_DEFLATE)
+		return NULL;
+	z = u_zalloc(sizeof(*z));
+	z->max_len = max_len;
+	/*
+	 * Let zlib detect the header: some peers send gzip data
+	 * labelled as deflate.
+	 */
+	if (inflateInit2(&z->strm, MAX_WBITS + 32) != Z_OK) {
+		u_free(z);
+		return NULL;
+	}
+	return z;
+}
+
+int
+wsman_inflater_update(WsmanInflater * z, const void *data,
+		      size_t len, u_buf_t * out)
+{
+	z->strm.next_in = (Bytef *) data;
+	z->strm.avail_in = len;
+
+	/*
+	 * zlib stops when either the input or the output space runs out,
+	 * keep going until it leaves room in the output.
+	 */
+	while (!z->finished) {
+		size_t have = u_buf_len(out);
+		size_t room;
+		int rc;
+
+		if (u_buf_size(out) - have < CODING_CHUNK &&
+		    u_buf_reserve(out, 2 * u_buf_size(out) + CODING_CHUNK))
+			return -1;
+		room = u_buf_size(out) - have;
+		z->strm.next_out = (Bytef *) u_buf_ptr(out) + have;
+		z->strm.avail_out = room;
+		rc = inflate(&z->strm, Z_NO_FLUSH);
+		if (rc == Z_BUF_ERROR)
+			break;	/* needs more input */
+		if (rc != Z_OK && rc != Z_STREAM_END)
+			return -1;
+		u_buf_set_len(out, have + room - z->strm.avail_out);
+		/* keep the buffer usable as a string, like u_buf_append() */
+		((char *) u_buf_ptr(out))[u_buf_len(out)] = '\0';
+		if (z->max_len && u_buf_len(out) > z->max_len)
+			return -2;
+		if (rc == Z_STREAM_END)
+			z->finished = 1;
+		else if (z->strm.avail_out != 0)
+			break;
+	}
+	/* Trailing garbage after the end of the stream */
+	if (z->strm.avail_in > 0)
+		return -1;
+	return 0;
+}
+
+int
+wsman_inflater_finished(WsmanInflater * z)
+{
+	return z->finished;
+}
+
+void
+wsman_inflater_free(WsmanInflater * z)
+{
+	if (z == NULL)
+		return;
+	inflateEnd(&z->strm);
+	u_free(z);
+}
+
+#else				/* HAVE_ZLIB */
+
+int
+wsman_deflate(WsmanContentCoding coding, int level,
+	      const char *data, size_t len, u_buf_t * out)
+{
+	return -1;
+}
+
+WsmanInflater *
+wsman_inflater_new(WsmanContentCoding coding, size_t max_len)
+{
+	return NULL;
+}
+
+int
+wsman_inflater_update(WsmanInflater * z, const void *data,
+		      size_t len, u_buf_t * out)
+{
+	return -1;
+}
+
+int
+wsman_inflater_finished(WsmanInflater * z)
+{
+	return 0;
+}
+
+void
+wsman_inflater_free(WsmanInflater * z)
+{
+}
+
+#endif				/* HAVE_ZLIB */
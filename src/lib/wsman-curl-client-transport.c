@@ -56,6 +56,7 @@
 #include "wsman-xml.h"
 #include "wsman-debug.h"
 #include "wsman-client-transport.h"
+#include "wsman-compress.h"
 
 #define DEFAULT_TRANSFER_LEN 32000
 
@@ -72,6 +73,46 @@ void wsmc_handler( WsManClient *cl, WsXmlDocH rqstDoc, void* user_data);
 
 static pthread_mutex_t curl_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * TLS sessions are shared by all clients of the process, so that a new
+ * WsManClient talking to a server we have already seen resumes the
+ * session instead of doing a full handshake.
+ */
+static CURLSH *ssl_share = NULL;
+static pthread_mutex_t ssl_share_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+ssl_share_lock(CURL *handle, curl_lock_data data,
+		curl_lock_access access, void *userptr)
+{
+	pthread_mutex_lock(&ssl_share_mutex);
+}
+
+static void
+ssl_share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+	pthread_mutex_unlock(&ssl_share_mutex);
+}
+
+static CURLSH *
+get_ssl_share(void)
+{
+	pthread_mutex_lock(&curl_mutex);
+	if (ssl_share == NULL) {
+		ssl_share = curl_share_init();
+		if (ssl_share &&
+		    (curl_share_setopt(ssl_share, CURLSHOPT_LOCKFUNC, ssl_share_lock) ||
+		     curl_share_setopt(ssl_share, CURLSHOPT_UNLOCKFUNC, ssl_share_unlock) ||
+		     curl_share_setopt(ssl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION))) {
+			debug("Could not set up TLS session sharing");
+			curl_share_cleanup(ssl_share);
+			ssl_share = NULL;
+		}
+	}
+	pthread_mutex_unlock(&curl_mutex);
+	return ssl_share;
+}
+
 
 static long
 reauthenticate(WsManClient *cl,
@@ -235,6 +276,35 @@ write_handler( void *ptr, size_t size, size_t nmemb, void *data)
 	return len;
 }
 
+/*
+ * A compressed response tells us the server understands Content-Encoding,
+ * from then on requests are compressed as well.
+ */
+static size_t
+header_handler(void *ptr, size_t size, size_t nmemb, void *data)
+{
+	WsManClient *cl = data;
+	size_t len = size * nmemb;
+	static const char name[] = "Content-Encoding:";
+	char value[32];
+	size_t n;
+
+	if (cl->compression > 0 && len > sizeof(name) - 1 &&
+	    strncasecmp(ptr, name, sizeof(name) - 1) == 0) {
+		n = len - (sizeof(name) - 1);
+		if (n >= sizeof(value))
+			n = sizeof(value) - 1;
+		memcpy(value, (char *)ptr + sizeof(name) - 1, n);
+		value[n] = '\0';
+		n = strcspn(value, "\r\n");
+		value[n] = '\0';
+		if (wsman_content_coding(value) != WSMAN_CODING_IDENTITY &&
+		    wsman_content_coding(value) != WSMAN_CODING_UNSUPPORTED)
+			cl->compress_requests = 1;
+	}
+	return len;
+}
+
 #ifdef ENABLE_EVENTING_SUPPORT
 static int ssl_certificate_thumbprint_verify_callback(X509_STORE_CTX *ctx, void *arg)
 {
@@ -291,6 +361,20 @@ init_curl_transport(WsManClient *cl)
 		goto DONE;
 	}
 
+	// resume TLS sessions, also across clients
+	r = curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+	if (r != 0) {
+		curl_err("curl_easy_setopt(CURLOPT_SSL_SESSIONID_CACHE) failed");
+		goto DONE;
+	}
+	if (get_ssl_share()) {
+		r = curl_easy_setopt(curl, CURLOPT_SHARE, ssl_share);
+		if (r != 0) {
+			curl_err("curl_easy_setopt(CURLOPT_SHARE) failed");
+			goto DONE;
+		}
+	}
+
 	r = curl_easy_setopt(curl, CURLOPT_PROXY, cl->proxy_data.proxy);
 	if (r != 0) {
 		curl_err("Could notcurl_easy_setopt(curl, CURLOPT_PROXY, ...)");
@@ -406,6 +490,7 @@ wsmc_handler( WsManClient *cl,
 	long auth_avail = 0;
 	char *_user = NULL, *_pass = NULL;
 	u_buf_t *response = NULL;
+	u_buf_t *zrequest = NULL;
 	//char *soapaction;
 
 	if (!cl->initialized && wsmc_transport_init(cl, NULL)) {
@@ -440,6 +525,24 @@ wsmc_handler( WsManClient *cl,
 		curl_err("Could not curl_easy_setopt(curl, CURLOPT_WRITEDATA, ..)");
 		goto DONE;
 	}
+	r = curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_handler);
+	if (r != CURLE_OK) {
+		cl->fault_string = u_strdup(curl_easy_strerror(r));
+		curl_err("Could not curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ..)");
+		goto DONE;
+	}
+	r = curl_easy_setopt(curl, CURLOPT_HEADERDATA, cl);
+	if (r != CURLE_OK) {
+		cl->fault_string = u_strdup(curl_easy_strerror(r));
+		curl_err("Could not curl_easy_setopt(curl, CURLOPT_HEADERDATA, ..)");
+		goto DONE;
+	}
+	/* "" lets curl offer, and decode, every coding it was built with */
+	r = curl_easy_setopt(curl, CURLOPT_ENCODING,
+			     cl->compression > 0 ? "" : NULL);
+	if (r != CURLE_OK) {
+		curl_err("Could not curl_easy_setopt(curl, CURLOPT_ENCODING, ..)");
+	}
 	char content_type[64];
 	snprintf(content_type, 64, "Content-Type: application/soap+xml;charset=%s", cl->content_encoding);
 	headers = curl_slist_append(headers, content_type);
@@ -466,14 +569,25 @@ wsmc_handler( WsManClient *cl,
 	}
 #endif
 
+	ws_xml_dump_memory_enc(rqstDoc, &buf, &len, cl->content_encoding);
+	if (cl->compress_requests && len >= WSMAN_COMPRESS_MIN_SIZE) {
+		u_buf_create(&zrequest);
+		if (wsman_deflate(WSMAN_CODING_GZIP, cl->compression,
+				  buf, len, zrequest) == 0) {
+			headers = curl_slist_append(headers,
+						    "Content-Encoding: gzip");
+		} else {
+			u_buf_free(zrequest);
+			zrequest = NULL;
+		}
+	}
+
 	r = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 	if (r != CURLE_OK) {
 		cl->fault_string = u_strdup(curl_easy_strerror(r));
 		curl_err("Could not curl_easy_setopt(curl, CURLOPT_HTTPHEADER, ..)");
 		goto DONE;
 	}
-
-	ws_xml_dump_memory_enc(rqstDoc, &buf, &len, cl->content_encoding);
 #if 0
 	int count = 0;
 	while(count < len) {
@@ -481,13 +595,19 @@ wsmc_handler( WsManClient *cl,
 	}
 #endif
 	debug("*****set post buf len = %d******",len);
-	r = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, buf);
+	if (zrequest) {
+		debug("request compressed to %d bytes", u_buf_len(zrequest));
+		r = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, u_buf_ptr(zrequest));
+	} else {
+		r = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, buf);
+	}
 	if (r != CURLE_OK) {
 		cl->fault_string = u_strdup(curl_easy_strerror(r));
 		curl_err("Could not curl_easy_setopt(curl, CURLOPT_POSTFIELDS, ..)");
 		goto DONE;
 	}
-	r = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, len);
+	r = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE,
+			     zrequest ? (long) u_buf_len(zrequest) : len);
 	if (r != CURLE_OK) {
 		cl->fault_string = u_strdup(curl_easy_strerror(r));
 		curl_err("Could not curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, ..)");
@@ -626,6 +746,8 @@ DONE:
 
 	curl_slist_free_all(headers);
 	u_buf_free(response);
+	if (zrequest)
+		u_buf_free(zrequest);
 	u_free(soapact_header);
 	u_free(usag);
 	u_free(upwd);
@@ -62,48 +62,6 @@
  * @{
  */
 
-struct __MuHeaderInfo {
-	char *ns;
-	char *name;
-};
-
-static int is_mu_header(WsXmlNodeH header)
-{
-	int i;
-	char *name, *ns;
-	static struct __MuHeaderInfo s_Info[] = {
-		{XML_NS_ADDRESSING, WSA_TO},
-		{XML_NS_ADDRESSING, WSA_MESSAGE_ID},
-		{XML_NS_ADDRESSING, WSA_RELATES_TO},
-		{XML_NS_ADDRESSING, WSA_ACTION},
-		{XML_NS_ADDRESSING, WSA_REPLY_TO},
-		{XML_NS_ADDRESSING, WSA_FROM},
-		{XML_NS_WS_MAN, WSM_RESOURCE_URI},
-		{XML_NS_WS_MAN, WSM_SELECTOR_SET},
-		{XML_NS_WS_MAN, WSM_MAX_ENVELOPE_SIZE},
-		{XML_NS_WS_MAN, WSM_OPERATION_TIMEOUT},
-		{XML_NS_WS_MAN, WSM_FRAGMENT_TRANSFER},
-		{XML_NS_TRUST, WST_ISSUEDTOKENS},
-		{NULL, NULL}
-	};
-
-	name = ws_xml_get_node_local_name(header);
-	ns = ws_xml_get_node_name_ns(header);
-
-	for (i = 0; s_Info[i].name != NULL; i++) {
-		if ((ns == NULL && s_Info[i].ns == NULL) ||
-		    (ns != NULL && s_Info[i].ns != NULL &&
-		     !strcmp(ns, s_Info[i].ns))) {
-			if (!strcmp(name, s_Info[i].name))
-				return 1;
-		}
-	}
-	debug("mustUnderstand: %s:%s", !ns ? "null" : ns, name ? name : "NULL");
-	return 0;
-}
-
-
-
 static void
 generate_op_fault(op_t * op,
 			WsmanFaultCodeType faultCode,
@@ -151,13 +109,12 @@ generate_notunderstood_fault(op_t * op,
 
 static int check_for_duplicate_selectors(op_t * op)
 {
-	WsXmlNodeH header, node, selector;
+	WsXmlNodeH node, selector;
 	int retval = 0, index = 0;
 	hash_t *h;
 
-	header = wsman_get_soap_header_element( op->in_doc, NULL, NULL);
-	if ((node = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
-			      WSM_SELECTOR_SET)) == NULL) {
+	if (op->headers == NULL ||
+	    (node = op->headers->selector_set) == NULL) {
 		// No selectors
 		return 0;
 	}
@@ -205,9 +162,10 @@ static int validate_control_headers(op_t * op)
 	WsXmlNodeH header, child, maxsize;
 	char *mu = NULL;
 
-	header = wsman_get_soap_header_element( op->in_doc,  NULL, NULL);
-	maxsize = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
-			     WSM_MAX_ENVELOPE_SIZE);
+	if (op->headers == NULL)
+		return 1;
+	header = op->headers->header;
+	maxsize = op->headers->max_envelope_size;
 	mu = ws_xml_find_attr_value(maxsize, XML_NS_SOAP_1_2,
 				    SOAP_MUST_UNDERSTAND);
 	if (mu != NULL && strcmp(mu, "true") == 0) {
@@ -221,8 +179,7 @@ static int validate_control_headers(op_t * op)
 		}
 		op->maxsize = size;
 	}
-	child = ws_xml_get_child(header, 0,
-				 XML_NS_WS_MAN, WSM_OPERATION_TIMEOUT);
+	child = op->headers->operation_timeout;
 	if (child != NULL) {
 		char *text = ws_xml_get_node_text(child);
 		char *nsUri = ws_xml_get_node_name_ns(header);
@@ -254,20 +211,10 @@ static int validate_control_headers(op_t * op)
 static WsXmlNodeH
 validate_mustunderstand_headers(op_t * op)
 {
-	WsXmlNodeH child = NULL, header = NULL;
-	int i;
-	char *nsUri;
+	WsXmlNodeH child = NULL;
 
-	header = wsman_get_soap_header_element(op->in_doc, NULL, NULL);
-	nsUri = ws_xml_get_node_name_ns(header);
-
-	for (i = 0;(child = ws_xml_get_child(header, i, NULL, NULL)) != NULL; i++) {
-		if (ws_xml_find_attr_bool(child, nsUri, SOAP_MUST_UNDERSTAND)) {
-			if (!is_mu_header(child)) {
-				break;
-			}
-		}
-	}
+	if (op->headers != NULL)
+		child = op->headers->not_understood;
 
 	if (child != NULL) {
 		debug("Mustunderstand Fault: %s", ws_xml_get_node_text(child));
@@ -302,7 +249,8 @@ check_unsupported_features(op_t * op)
 {
 	WsXmlNodeH enumurate;
 	WsXmlNodeH subscribe;
-	WsXmlNodeH header = wsman_get_soap_header_element( op->in_doc, NULL, NULL);
+	static WsmanHeaderIndex no_headers;
+	WsmanHeaderIndex *headers = op->headers ? op->headers : &no_headers;
 	WsXmlNodeH body = ws_xml_get_soap_body(op->in_doc);
 	int retVal = 0;
 	WsXmlNodeH n, m, k;
@@ -310,14 +258,14 @@ check_unsupported_features(op_t * op)
 	WsXmlAttrH attr = NULL;
 
 
-	n = ws_xml_get_child(header, 0, XML_NS_ADDRESSING, WSA_FAULT_TO);
+	n = headers->fault_to;
 	if (n != NULL) {
 		retVal = 1;
 		generate_op_fault(op, WSMAN_UNSUPPORTED_FEATURE,
 					WSMAN_DETAIL_ADDRESSING_MODE);
 		goto DONE;
 	}
-	n = ws_xml_get_child(header, 0, XML_NS_WS_MAN, WSM_LOCALE);
+	n = headers->locale;
 	if (n != NULL) {
 		debug("Locale header found");
 		mu = ws_xml_find_attr_value(n, XML_NS_SOAP_1_2,
@@ -331,8 +279,7 @@ check_unsupported_features(op_t * op)
 		}
 	}
 #if 0
-	n = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
-			     WSM_FRAGMENT_TRANSFER);
+	n = headers->fragment_transfer;
 	if (n != NULL) {
 		debug("FragmentTransfer header found");
 		mu = ws_xml_find_attr_value(n, XML_NS_SOAP_1_2,
@@ -383,7 +330,7 @@ check_unsupported_features(op_t * op)
 			goto DONE;
 			}
 	}
-	k = ws_xml_get_child(header, 0, XML_NS_WS_MAN, WSM_RESOURCE_URI);
+	k = headers->resource_uri;
 	if (k)
 		resource_uri = ws_xml_get_node_text(k);
 	if (resource_uri &&
@@ -445,15 +392,14 @@ DONE:
  */
 static int wsman_is_duplicate_message_id(op_t * op)
 {
-	WsXmlNodeH header = wsman_get_soap_header_element(op->in_doc, NULL, NULL);
 	int retVal = 0;
 	SoapH soap;
-	WsXmlNodeH msgIdNode;
+	WsXmlNodeH msgIdNode = NULL;
 	soap = op->dispatch->soap;
 
-	msgIdNode = ws_xml_get_child(header, 0, XML_NS_ADDRESSING, WSA_MESSAGE_ID);
+	if (op->headers)
+		msgIdNode = op->headers->message_id;
 	if (msgIdNode != NULL) {
-		lnode_t *node;
 		char *msgId;
 		msgId = ws_xml_get_node_text(msgIdNode);
 		if (msgId[0] == 0 ) {
@@ -462,44 +408,14 @@ static int wsman_is_duplicate_message_id(op_t * op)
 			return 1;
 		}
 		debug("Checking Message ID: %s", msgId);
-		u_lock(soap);
-
-		if (soap->processedMsgIdList == NULL) {
-			soap->processedMsgIdList = list_create(LISTCOUNT_T_MAX);
-		}
 #ifndef IGNORE_DUPLICATE_ID
-		node = list_first(soap->processedMsgIdList);
-		while (node != NULL) {
-			if (!strcmp(msgId, (char *) node->list_data)) {
-				debug("Duplicate Message ID: %s", msgId);
-				retVal = 1;
-				generate_op_fault(op, WSA_INVALID_MESSAGE_INFORMATION_HEADER,
-							WSA_DETAIL_DUPLICATE_MESSAGE_ID);
-				break;
-			}
-			node = list_next(soap->processedMsgIdList, node);
+		if (wsman_msgid_set_check(soap->processedMsgIds, msgId)) {
+			debug("Duplicate Message ID: %s", msgId);
+			retVal = 1;
+			generate_op_fault(op, WSA_INVALID_MESSAGE_INFORMATION_HEADER,
+						WSA_DETAIL_DUPLICATE_MESSAGE_ID);
 		}
 #endif
-
-
-		if (!retVal) {
-			while (list_count(soap->processedMsgIdList) >= PROCESSED_MSG_ID_MAX_SIZE) {
-				node = list_del_first(soap->processedMsgIdList);
-				u_free(node->list_data);
-				u_free(node);
-			}
-
-			node = lnode_create(NULL);
-			if (node) {
-				node->list_data = u_str_clone(msgId);
-				if (node->list_data == NULL) {
-					u_free(node);
-				} else {
-					list_append(soap->processedMsgIdList, node);
-				}
-			}
-		}
-		u_unlock(soap);
 	} else if (!wsman_is_identify_request(op->in_doc)) {
 		generate_op_fault(op, WSA_MESSAGE_INFORMATION_HEADER_REQUIRED, 0);
 		debug("No MessageId Header found");
@@ -661,20 +577,23 @@ static int process_filters(op_t * op, int inbound, void *opaqueData)
 static void
 dispatcher_create_fault(SoapH soap, WsmanMessage * msg, WsXmlDocH in_doc)
 {
-	char *buf = NULL;
-	int len;
+	WsXmlDocH fault;
 	if (!soap)
 		return;
 
 	if (wsman_fault_occured(msg)) {
-		wsman_generate_fault_buffer(in_doc,
-					    msg->charset,
-					    msg->status.fault_code,
-					    msg->status.fault_detail_code,
-					    msg->status.fault_msg,
-					    &buf, &len);
-		u_buf_set(msg->response, buf, len);
-		u_free(buf);
+		fault = wsman_generate_fault(in_doc,
+					     msg->status.fault_code,
+					     msg->status.fault_detail_code,
+					     msg->status.fault_msg);
+		debug("Fault Code: %d", msg->status.fault_code);
+		/* like responses, faults are serialized into msg->response */
+		u_buf_clear(msg->response);
+		if (fault) {
+			ws_xml_dump_memory_buf(fault, msg->response,
+					       msg->charset);
+			ws_xml_destroy_doc(fault);
+		}
 		msg->http_code = wsman_find_httpcode_for_fault_code(
 						msg->status.
 					    fault_code);
@@ -687,8 +606,6 @@ static int
 process_inbound_operation(op_t * op, WsmanMessage * msg, void *opaqueData)
 {
 	int retVal = 1;
-	char *buf = NULL;
-	int len;
 
 	msg->http_code = WSMAN_STATUS_OK;
 	op->out_doc = NULL;
@@ -713,11 +630,12 @@ process_inbound_operation(op_t * op, WsmanMessage * msg, void *opaqueData)
 			error("not fault envelope");
 		}
 
-		ws_xml_dump_memory_enc(op->out_doc, &buf, &len, msg->charset);
-		u_buf_set(msg->response, buf, len);
+		u_buf_clear(msg->response);
+		if (ws_xml_dump_memory_buf(op->out_doc, msg->response,
+					   msg->charset))
+			goto SERIALIZE_FAILED;
 		ws_xml_destroy_doc(op->out_doc);
 		op->out_doc = NULL;
-		u_free(buf);
 		return 1;
 	}
 
@@ -747,13 +665,38 @@ process_inbound_operation(op_t * op, WsmanMessage * msg, void *opaqueData)
 	else {
 		wsman_add_fragement_for_header(op->in_doc, op->out_doc);
 	}
-	ws_xml_dump_memory_enc(op->out_doc, &buf, &len, msg->charset);
-	u_buf_set(msg->response, buf, len);
+	/* serialize straight into the response, no intermediate buffer */
+	u_buf_clear(msg->response);
+	if (ws_xml_dump_memory_buf(op->out_doc, msg->response, msg->charset))
+		goto SERIALIZE_FAILED;
+	/* the envelope limit is checked on what was actually serialized */
+	if (op->maxsize > 0 && u_buf_len(msg->response) > op->maxsize) {
+		debug("response exceeds MaxEnvelopeSize: %lu > %lu",
+		      (unsigned long) u_buf_len(msg->response), op->maxsize);
+		generate_op_fault(op, WSMAN_ENCODING_LIMIT,
+				  WSMAN_DETAIL_SERVICE_ENVELOPE_LIMIT);
+		if (op->out_doc != NULL) {
+			msg->http_code =
+			    wsman_find_httpcode_for_value(op->out_doc);
+			u_buf_clear(msg->response);
+			if (ws_xml_dump_memory_buf(op->out_doc,
+						   msg->response,
+						   msg->charset))
+				goto SERIALIZE_FAILED;
+		}
+	}
 	ws_xml_destroy_doc(op->out_doc);
 	op->out_doc = NULL;
-	u_free(buf);
 	return 0;
 
+      SERIALIZE_FAILED:
+	/* a partial response must not go out, the caller sends the fault */
+	error("response could not be serialized");
+	u_buf_clear(msg->response);
+	ws_xml_destroy_doc(op->out_doc);
+	op->out_doc = NULL;
+	wsman_set_fault(msg, WSMAN_INTERNAL_ERROR, OWSMAN_NO_DETAILS, NULL);
+	retVal = 1;
       GENERATE_FAULT:
 	return retVal;
 }
@@ -809,6 +752,7 @@ dispatch_inbound_call(SoapH soap, WsmanMessage * msg, void *opaqueData)
 		goto DONE;
 	}
 	op->in_doc = in_doc;
+	op->headers = wsman_get_header_index(in_doc);
 	process_inbound_operation(op, msg, opaqueData);
 DONE:
 	dispatcher_create_fault(soap, msg, in_doc);
@@ -845,58 +789,315 @@ static char *wsman_dispatcher_match_ns(WsDispatchInterfaceInfo * r,
 }
 
 
-WsEndPointRelease
-wsman_get_release_endpoint(WsContextH cntx, WsXmlDocH doc)
+/*
+ * Routing index.
+ *
+ * Built once all plugins are registered and only read afterwards.
+ * Resource URIs are looked up in a hash, plugin namespaces in a trie
+ * keyed by the '/' separated segments of the URI, and actions in a hash
+ * per interface. When several interfaces match, the first one in the
+ * interface list wins, as it always did.
+ */
+typedef struct {
+	WsDispatchInterfaceInfo *ifc;
+	hash_t *actions;		/* inAction -> endpoint */
+	WsDispatchEndPointInfo *custom;	/* Last endpoint without inAction */
+	SoapDispatchH *disps;		/* Per endpoint, NULL if not registered */
+} RouteInterface;
+
+typedef struct {
+	RouteInterface *ri;
+	char *ns;		/* Matching namespace, NULL for a resource URI */
+	int order;		/* Position in the interface list */
+	int nsorder;		/* Position in the namespace list */
+} RouteTarget;
+
+typedef struct {
+	hash_t *children;	/* URI segment -> RouteNode */
+	RouteTarget *target;	/* A namespace ends here */
+} RouteNode;
+
+struct _WsmanRoutes {
+	RouteInterface *interfaces;
+	int ninterfaces;
+	RouteTarget *targets;
+	int ntargets;
+	hash_t *uris;		/* Resource URI -> RouteTarget */
+	RouteNode *root;	/* Namespaces */
+	SoapDispatchH identify;
+};
+
+#define ROUTE_MAX_SEGMENT 256
+
+static int route_before(RouteTarget *a, RouteTarget *b)
+{
+	if (b == NULL)
+		return 1;
+	return a->order < b->order ||
+	    (a->order == b->order && a->nsorder < b->nsorder);
+}
+
+static void route_add_ns(RouteNode *node, RouteTarget *t)
+{
+	const char *p = t->ns, *e;
+	size_t len = strlen(p);
+	char *seg;
+	hnode_t *hn;
+	RouteNode *child;
+
+	while (len > 0 && p[len - 1] == '/')
+		len--;
+	while (len > 0) {
+		for (e = p; e < t->ns + len && *e != '/'; e++);
+		seg = u_strndup(p, e - p);
+		if (node->children == NULL)
+			node->children = hash_create(HASHCOUNT_T_MAX, 0, 0);
+		if ((hn = hash_lookup(node->children, seg)) != NULL) {
+			child = (RouteNode *) hnode_get(hn);
+			u_free(seg);
+		} else {
+			child = u_zalloc(sizeof(RouteNode));
+			hash_alloc_insert(node->children, seg, child);
+		}
+		node = child;
+		if (e == t->ns + len)
+			break;
+		p = e + 1;
+	}
+	if (route_before(t, node->target))
+		node->target = t;
+}
+
+static void route_free_node(RouteNode *node)
+{
+	hscan_t hs;
+	hnode_t *hn;
+
+	if (node->children) {
+		hash_scan_begin(&hs, node->children);
+		while ((hn = hash_scan_next(&hs)) != NULL) {
+			u_free((void *) hnode_getkey(hn));
+			route_free_node((RouteNode *) hnode_get(hn));
+		}
+		hash_free_nodes(node->children);
+		hash_destroy(node->children);
+	}
+	u_free(node);
+}
+
+static SoapDispatchH route_find_disp(WsManDispatcherInfo *dispInfo,
+				     WsDispatchEndPointInfo *ep)
 {
-	WsManDispatcherInfo *dispInfo =
-	    (WsManDispatcherInfo *) cntx->soap->dispatcherData;
-	lnode_t *node = NULL;
-	WsDispatchInterfaceInfo *r = NULL;
-	WsDispatchEndPointInfo *ep = NULL;
-	char *ptr = ENUM_ACTION_RELEASE, *ns = NULL, *uri = NULL;
 	int i;
 
-	if (dispInfo->interfaces) {
-		node = list_first((list_t *) dispInfo->interfaces);
+	for (i = 0; i < dispInfo->mapCount; i++) {
+		if (dispInfo->map[i].ep == ep)
+			return dispInfo->map[i].disp;
 	}
-	uri = wsman_get_resource_uri(cntx, doc);
+	return NULL;
+}
 
-	while (node != NULL) {
+void *wsman_dispatcher_routes_new(WsManDispatcherInfo *dispInfo)
+{
+	struct _WsmanRoutes *routes = u_zalloc(sizeof(struct _WsmanRoutes));
+	list_t *interfaces = (list_t *) dispInfo->interfaces;
+	lnode_t *node, *nsnode;
+	int i, j, n, nns;
+
+	n = list_count(interfaces);
+	nns = 0;
+	for (node = list_first(interfaces); node;
+	     node = list_next(interfaces, node)) {
 		WsDispatchInterfaceInfo *ifc =
 		    (WsDispatchInterfaceInfo *) node->list_data;
-		if (ifc->wsmanResourceUri == NULL &&
-		    (ns = wsman_dispatcher_match_ns(ifc, uri))) {
-			r = ifc;
-			break;
+		nns += ifc->namespaces ? list_count(ifc->namespaces) : 0;
+	}
+	routes->interfaces = u_zalloc((n + 1) * sizeof(RouteInterface));
+	routes->targets = u_zalloc((n + nns + 1) * sizeof(RouteTarget));
+	routes->uris = hash_create(HASHCOUNT_T_MAX, 0, 0);
+	routes->root = u_zalloc(sizeof(RouteNode));
+
+	for (i = 0, node = list_first(interfaces); node;
+	     i++, node = list_next(interfaces, node)) {
+		WsDispatchInterfaceInfo *ifc =
+		    (WsDispatchInterfaceInfo *) node->list_data;
+		RouteInterface *ri = &routes->interfaces[i];
+		RouteTarget *t;
+
+		ri->ifc = ifc;
+		ri->actions = hash_create(HASHCOUNT_T_MAX, 0, 0);
+		for (j = 0; ifc->endPoints[j].serviceEndPoint != NULL; j++);
+		ri->disps = u_zalloc((j + 1) * sizeof(SoapDispatchH));
+		for (j = 0; ifc->endPoints[j].serviceEndPoint != NULL; j++) {
+			WsDispatchEndPointInfo *ep = &ifc->endPoints[j];
+
+			ri->disps[j] = route_find_disp(dispInfo, ep);
+			if (ep->inAction == NULL)
+				ri->custom = ep;
+			else if (hash_lookup(ri->actions, ep->inAction) == NULL)
+				hash_alloc_insert(ri->actions, ep->inAction, ep);
 		}
+		routes->ninterfaces++;
+
 		if (ifc->wsmanResourceUri &&
-		    !strcmp(uri, ifc->wsmanResourceUri)) {
-			r = ifc;
-			break;
+		    hash_lookup(routes->uris, ifc->wsmanResourceUri) == NULL) {
+			t = &routes->targets[routes->ntargets++];
+			t->ri = ri;
+			t->order = i;
+			hash_alloc_insert(routes->uris, ifc->wsmanResourceUri, t);
+		}
+		if (ifc->namespaces == NULL)
+			continue;
+		for (j = 0, nsnode = list_first(ifc->namespaces); nsnode;
+		     j++, nsnode = list_next(ifc->namespaces, nsnode)) {
+			WsSupportedNamespaces *sns =
+			    (WsSupportedNamespaces *) nsnode->list_data;
+
+			if (sns->ns == NULL)
+				continue;
+			if (routes->identify == NULL &&
+			    strstr(XML_NS_WSMAN_ID, sns->ns))
+				routes->identify = ri->disps[0];
+			/* Interfaces with a resource URI do not serve namespaces */
+			if (ifc->wsmanResourceUri)
+				continue;
+			t = &routes->targets[routes->ntargets++];
+			t->ri = ri;
+			t->ns = sns->ns;
+			t->order = i;
+			t->nsorder = j;
+			route_add_ns(routes->root, t);
 		}
-		node = list_next((list_t *) dispInfo->interfaces, node);
 	}
-	if (r == NULL) {
-		u_free(ns);
+	debug("Routing index: %d interfaces, %lu resource URIs, %d namespaces",
+	      routes->ninterfaces, hash_count(routes->uris), nns);
+	return routes;
+}
+
+void wsman_dispatcher_routes_free(void *data)
+{
+	struct _WsmanRoutes *routes = data;
+	int i;
+
+	if (routes == NULL)
+		return;
+	for (i = 0; i < routes->ninterfaces; i++) {
+		hash_free_nodes(routes->interfaces[i].actions);
+		hash_destroy(routes->interfaces[i].actions);
+		u_free(routes->interfaces[i].disps);
+	}
+	hash_free_nodes(routes->uris);
+	hash_destroy(routes->uris);
+	route_free_node(routes->root);
+	u_free(routes->interfaces);
+	u_free(routes->targets);
+	u_free(routes);
+}
+
+/*
+ * Find the interface serving uri, one probe per URI segment. Namespaces
+ * are expected to end on a segment boundary of the URI, anything else
+ * is only found by the scan of the interface list done on a miss.
+ */
+static RouteTarget *route_lookup(struct _WsmanRoutes *routes,
+				 const char *uri)
+{
+	RouteTarget *best = NULL;
+	RouteNode *node = routes->root;
+	const char *p = uri, *e;
+	char seg[ROUTE_MAX_SEGMENT];
+	hnode_t *hn;
+
+	if ((hn = hash_lookup(routes->uris, uri)) != NULL)
+		best = (RouteTarget *) hnode_get(hn);
+	for (;;) {
+		if (node->target && route_before(node->target, best) &&
+		    strstr(uri, node->target->ns))
+			best = node->target;
+		if (*p == '\0' || node->children == NULL)
+			break;
+		for (e = p; *e && *e != '/'; e++);
+		if ((size_t) (e - p) >= sizeof(seg))
+			break;
+		memcpy(seg, p, e - p);
+		seg[e - p] = '\0';
+		if ((hn = hash_lookup(node->children, seg)) == NULL)
+			break;
+		node = (RouteNode *) hnode_get(hn);
+		p = *e ? e + 1 : e;
+	}
+	return best;
+}
+
+/* The old way, for namespaces that do not end on a segment boundary */
+static RouteInterface *route_scan(struct _WsmanRoutes *routes,
+				  const char *uri, char **ns)
+{
+	int i;
+
+	for (i = 0; i < routes->ninterfaces; i++) {
+		WsDispatchInterfaceInfo *ifc = routes->interfaces[i].ifc;
+
+		if (ifc->wsmanResourceUri == NULL &&
+		    (*ns = wsman_dispatcher_match_ns(ifc, (char *) uri)))
+			return &routes->interfaces[i];
+		if (ifc->wsmanResourceUri &&
+		    !strcmp(uri, ifc->wsmanResourceUri))
+			return &routes->interfaces[i];
+	}
+	return NULL;
+}
+
+static RouteInterface *route_interface(struct _WsmanRoutes *routes,
+				       const char *uri, char **ns)
+{
+	RouteTarget *t;
+
+	*ns = NULL;
+	if (uri == NULL)
 		return NULL;
+	if ((t = route_lookup(routes, uri)) != NULL) {
+		if (t->ns)
+			*ns = u_strdup(t->ns);
+		return t->ri;
 	}
-	/*
-	 * See if the action is part of the namespace which means that
-	 * we are dealing with a custom action
-	 */
+	return route_scan(routes, uri, ns);
+}
+
+/*
+ * Endpoint of ri for action. Custom actions in the namespace of the
+ * plugin are registered without it.
+ */
+static WsDispatchEndPointInfo *route_action(RouteInterface *ri,
+					    const char *ns, const char *action)
+{
+	hnode_t *hn;
+
 	if (ns != NULL) {
 		size_t len = strlen(ns);
-		if (!strncmp(ptr, ns, len) && ptr[len] == '/') {
-			ptr += len + 1;
-		}
+		if (!strncmp(action, ns, len) && action[len] == '/')
+			action += len + 1;
 	}
-	for (i = 0; r->endPoints[i].serviceEndPoint != NULL; i++) {
-		if (r->endPoints[i].inAction != NULL &&
-		    !strcmp(ptr, r->endPoints[i].inAction)) {
-			ep = &r->endPoints[i];
-			break;
-		}
+	if ((hn = hash_lookup(ri->actions, action)) != NULL)
+		return (WsDispatchEndPointInfo *) hnode_get(hn);
+	return NULL;
+}
+
+WsEndPointRelease
+wsman_get_release_endpoint(WsContextH cntx, WsXmlDocH doc)
+{
+	WsManDispatcherInfo *dispInfo =
+	    (WsManDispatcherInfo *) cntx->soap->dispatcherData;
+	RouteInterface *ri;
+	WsDispatchEndPointInfo *ep = NULL;
+	char *ns = NULL, *uri;
+
+	uri = wsman_get_resource_uri(cntx, doc);
+	ri = route_interface(dispInfo->routes, uri, &ns);
+	if (ri == NULL) {
+		return NULL;
 	}
+	ep = route_action(ri, ns, ENUM_ACTION_RELEASE);
 	u_free(ns);
 
 	if (ep == NULL) {
@@ -913,22 +1114,18 @@ SoapDispatchH wsman_dispatcher(WsContextH cntx, void *data, WsXmlDocH doc)
 	char *uri = NULL, *action;
 	WsManDispatcherInfo *dispInfo = (WsManDispatcherInfo *) data;
 	WsDispatchEndPointInfo *ep = NULL;
-	WsDispatchEndPointInfo *ep_custom = NULL;
+	RouteInterface *ri;
 
 	WsXmlDocH notdoc = NULL;
 
 #ifdef ENABLE_EVENTING_SUPPORT
 	WsXmlNodeH nodedoc = NULL;
 #endif
-  /* FIXME: resUriMatch set but not used */
-	int i, resUriMatch = 0;
 	char *ns = NULL;
 
-	WsDispatchInterfaceInfo *r = NULL;
-	lnode_t *node = list_first((list_t *) dispInfo->interfaces);
-
 	if (doc == NULL) {
 		error("doc is null");
+		wsman_dispatcher_routes_free(dispInfo->routes);
 		u_free(data);
 		goto cleanup;
 	}
@@ -976,84 +1173,16 @@ SoapDispatchH wsman_dispatcher(WsContextH cntx, void *data, WsXmlDocH doc)
 	if ((!uri || !action) && !wsman_is_identify_request(doc)) {
 		goto cleanup;
 	}
-	while (node != NULL) {
-
-		WsDispatchInterfaceInfo *ifc = (WsDispatchInterfaceInfo *) node->list_data;
-		if (wsman_is_identify_request(doc)) {
-			if ((ns = wsman_dispatcher_match_ns(ifc,
-						       XML_NS_WSMAN_ID))) {
-				r = ifc;
-				resUriMatch = 1;
-				break;
-			}
-			debug("ns did not match");
-		}
-		/*
-		 * If Resource URI is null then most likely we are dealing
-		 * with  a generic plugin supporting a namespace with
-		 * multiple Resource URIs (e.g. CIM)
-		 **/
-		else if (ifc->wsmanResourceUri == NULL &&
-			 (ns = wsman_dispatcher_match_ns(ifc, uri))) {
-			r = ifc;
-			resUriMatch = 1;
-			break;
-		} else if (ifc->wsmanResourceUri &&
-			   !strcmp(uri, ifc->wsmanResourceUri)) {
-			r = ifc;
-			resUriMatch = 1;
-			break;
-		}
-		node = list_next((list_t *) dispInfo->interfaces, node);
-	}
-
-
-	if (wsman_is_identify_request(doc) && r != NULL) {
-		ep = &r->endPoints[0];
-	} else if (r != NULL) {
-		char *ptr = action;
-		/*
-		 * See if the action is part of the namespace which means that
-		 * we are dealing with a custom action
-		 */
-		if (ns != NULL) {
-			size_t len = strlen(ns);
-			if (!strncmp(action, ns, len) &&
-			    action[len] == '/')
-				ptr = &action[len + 1];
-		}
-		for (i = 0; r->endPoints[i].serviceEndPoint != NULL; i++) {
-			if (r->endPoints[i].inAction != NULL &&
-			    !strcmp(ptr, r->endPoints[i].inAction)) {
-				ep = &r->endPoints[i];
-				break;
-			} else if (r->endPoints[i].inAction == NULL) {
-				/*
-				 * Just store it for later
-				 * in case no match is found for above condition
-				 */
-				ep_custom = &r->endPoints[i];
-			}
-		}
+	if (wsman_is_identify_request(doc)) {
+		disp = ((struct _WsmanRoutes *) dispInfo->routes)->identify;
+	} else if ((ri = route_interface(dispInfo->routes, uri, &ns)) != NULL) {
+		if ((ep = route_action(ri, ns, action)) == NULL)
+			ep = ri->custom;
+		if (ep != NULL)
+			disp = ri->disps[ep - ri->ifc->endPoints];
 	}
 	ws_remove_context_val(cntx, WSM_RESOURCE_URI);
 
-	if (ep != NULL) {
-		for (i = 0; i < dispInfo->mapCount; i++) {
-			if (dispInfo->map[i].ep == ep) {
-				disp = dispInfo->map[i].disp;
-				break;
-			}
-		}
-	} else if (ep_custom != NULL) {
-		for (i = 0; i < dispInfo->mapCount; i++) {
-			if (dispInfo->map[i].ep == ep_custom) {
-				disp = dispInfo->map[i].disp;
-				break;
-			}
-		}
-	}
-
 cleanup:
 	if(notdoc)
 		ws_xml_destroy_doc(notdoc);
@@ -133,6 +133,90 @@ void xml_parser_doc_to_memory(WsXmlDocH doc, char **buf,
 				(!encoding) ? "UTF-8" : encoding);
 }
 
+static int write_to_buf(void *context, const char *buffer, int len)
+{
+	u_buf_t *buf = (u_buf_t *) context;
+	size_t size = u_buf_size(buf);
+
+	if (len <= 0)
+		return 0;
+	/* grow geometrically, libxml2 writes in small chunks */
+	if (size - u_buf_len(buf) < (size_t) len &&
+	    u_buf_reserve(buf, 2 * size > u_buf_len(buf) + len ?
+			  2 * size : u_buf_len(buf) + len))
+		return -1;
+	if (u_buf_append(buf, (void *) buffer, len))
+		return -1;
+	return len;
+}
+
+int xml_parser_doc_to_buf(WsXmlDocH doc, u_buf_t *buf,
+			  const char *encoding)
+{
+	xmlOutputBufferPtr out;
+
+	if (!doc || !buf)
+		return -1;
+	if (!encoding)
+		encoding = "UTF-8";
+	out = xmlOutputBufferCreateIO(write_to_buf, NULL, buf,
+				      xmlFindCharEncodingHandler(encoding));
+	if (out == NULL)
+		return -1;
+	return xmlSaveFormatFileTo(out, doc->parserDoc, encoding, 0) < 0;
+}
+
+static int count_bytes(void *context, const char *buffer, int len)
+{
+	*(long *) context += len;
+	return len;
+}
+
+/*
+ * Serialized size of a document or subtree, as xml_parser_doc_to_buf()
+ * would write it, without keeping the output around.
+ */
+long xml_parser_doc_size(WsXmlDocH doc, const char *encoding)
+{
+	xmlOutputBufferPtr out;
+	long size = 0;
+
+	if (!doc)
+		return -1;
+	if (!encoding)
+		encoding = "UTF-8";
+	out = xmlOutputBufferCreateIO(count_bytes, NULL, &size,
+				      xmlFindCharEncodingHandler(encoding));
+	if (out == NULL)
+		return -1;
+	if (xmlSaveFormatFileTo(out, doc->parserDoc, encoding, 0) < 0)
+		return -1;
+	return size;
+}
+
+long xml_parser_node_size(WsXmlNodeH node, const char *encoding)
+{
+	xmlNodePtr xmlNode = (xmlNodePtr) node;
+	xmlOutputBufferPtr out;
+	long size = 0;
+
+	if (!xmlNode)
+		return -1;
+	if (!encoding)
+		encoding = "UTF-8";
+	out = xmlOutputBufferCreateIO(count_bytes, NULL, &size,
+				      xmlFindCharEncodingHandler(encoding));
+	if (out == NULL)
+		return -1;
+	/* a byte order mark only starts the document, not the subtree */
+	xmlOutputBufferFlush(out);
+	size = 0;
+	xmlNodeDumpOutput(out, xmlNode->doc, xmlNode, 0, 0, encoding);
+	if (xmlOutputBufferClose(out) < 0)
+		return -1;
+	return size;
+}
+
 void xml_parser_free_memory(void *ptr)
 {
 	if (ptr)
@@ -0,0 +1,249 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+/**
+ * Duplicate MessageID detection.
+ *
+ * The set is split in shards by hash, each with its own lock, so
+ * concurrent requests rarely wait for each other. A shard is a chained
+ * hash table plus a FIFO of its entries in arrival order: since arrival
+ * order is expiry order, expired IDs are dropped from the head of the
+ * FIFO as new ones come in.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "wsman_config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "u/libu.h"
+#include "wsman-msgid.h"
+
+#define MSGID_SHARDS		16	/* Power of 2 */
+#define MSGID_MIN_BUCKETS	64	/* Per shard, power of 2 */
+
+typedef struct _MsgIdEntry {
+	struct _MsgIdEntry *chain;	/* Next in hash bucket */
+	struct _MsgIdEntry *newer;	/* Next in arrival order */
+	time_t seen;
+	unsigned int hash;
+	char id[1];
+} MsgIdEntry;
+
+typedef struct {
+	pthread_mutex_t lock;
+	MsgIdEntry **buckets;
+	unsigned long nbuckets;
+	unsigned long count;
+	MsgIdEntry *oldest;
+	MsgIdEntry *newest;
+} MsgIdShard;
+
+struct _WsmanMsgIdSet {
+	unsigned long window;
+	unsigned long max_per_shard;
+	MsgIdShard shards[MSGID_SHARDS];
+};
+
+
+/* FNV-1a */
+unsigned int wsman_id_hash(const char *s)
+{
+	unsigned int h = 2166136261U;
+
+	while (*s) {
+		h ^= (unsigned char) *s++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Bucket index, the low bits pick the shard */
+static unsigned long bucket_of(MsgIdShard *shard, unsigned int hash)
+{
+	return (hash / MSGID_SHARDS) & (shard->nbuckets - 1);
+}
+
+static void shard_grow(MsgIdShard *shard)
+{
+	unsigned long i, n = shard->nbuckets * 2;
+	MsgIdEntry **buckets = u_zalloc(n * sizeof(MsgIdEntry *));
+	MsgIdEntry *e, *next;
+
+	if (buckets == NULL)
+		return;
+	for (i = 0; i < shard->nbuckets; i++) {
+		for (e = shard->buckets[i]; e; e = next) {
+			next = e->chain;
+			e->chain = buckets[(e->hash / MSGID_SHARDS) & (n - 1)];
+			buckets[(e->hash / MSGID_SHARDS) & (n - 1)] = e;
+		}
+	}
+	u_free(shard->buckets);
+	shard->buckets = buckets;
+	shard->nbuckets = n;
+}
+
+static void shard_drop_oldest(MsgIdShard *shard)
+{
+	MsgIdEntry *e = shard->oldest, **pe;
+
+	pe = &shard->buckets[bucket_of(shard, e->hash)];
+	while (*pe != e)
+		pe = &(*pe)->chain;
+	*pe = e->chain;
+	shard->oldest = e->newer;
+	if (shard->oldest == NULL)
+		shard->newest = NULL;
+	shard->count--;
+	u_free(e);
+}
+
+/* Called with the shard lock held */
+static void shard_expire(WsmanMsgIdSet *set, MsgIdShard *shard, time_t now)
+{
+	while (shard->oldest &&
+	       (shard->oldest->seen + (time_t) set->window <= now ||
+		shard->oldest->seen > now))	/* the clock went back */
+		shard_drop_oldest(shard);
+}
+
+WsmanMsgIdSet *wsman_msgid_set_new(unsigned long window,
+				   unsigned long max_ids)
+{
+	WsmanMsgIdSet *set = u_zalloc(sizeof(WsmanMsgIdSet));
+	int i;
+
+	if (set == NULL)
+		return NULL;
+	set->window = window ? window : WSMAN_MSGID_WINDOW;
+	set->max_per_shard = (max_ids ? max_ids : WSMAN_MSGID_MAX) /
+	    MSGID_SHARDS;
+	if (set->max_per_shard == 0)
+		set->max_per_shard = 1;
+	for (i = 0; i < MSGID_SHARDS; i++) {
+		MsgIdShard *shard = &set->shards[i];
+
+		pthread_mutex_init(&shard->lock, NULL);
+		shard->nbuckets = MSGID_MIN_BUCKETS;
+		shard->buckets = u_zalloc(MSGID_MIN_BUCKETS *
+					  sizeof(MsgIdEntry *));
+	}
+	return set;
+}
+
+void wsman_msgid_set_destroy(WsmanMsgIdSet *set)
+{
+	MsgIdEntry *e, *next;
+	int i;
+
+	if (set == NULL)
+		return;
+	for (i = 0; i < MSGID_SHARDS; i++) {
+		for (e = set->shards[i].oldest; e; e = next) {
+			next = e->newer;
+			u_free(e);
+		}
+		u_free(set->shards[i].buckets);
+		pthread_mutex_destroy(&set->shards[i].lock);
+	}
+	u_free(set);
+}
+
+void wsman_msgid_set_window(WsmanMsgIdSet *set, unsigned long window)
+{
+	if (set && window)
+		set->window = window;
+}
+
+int wsman_msgid_set_check(WsmanMsgIdSet *set, const char *msgid)
+{
+	unsigned int hash;
+	MsgIdShard *shard;
+	time_t now = time(NULL);
+	size_t len = strlen(msgid);
+	MsgIdEntry *e;
+	int found = 0;
+
+	/* no set, nothing was seen */
+	if (set == NULL)
+		return 0;
+	hash = wsman_id_hash(msgid);
+	shard = &set->shards[hash & (MSGID_SHARDS - 1)];
+	pthread_mutex_lock(&shard->lock);
+	shard_expire(set, shard, now);
+
+	for (e = shard->buckets[bucket_of(shard, hash)]; e; e = e->chain) {
+		if (e->hash == hash && strcmp(e->id, msgid) == 0) {
+			found = 1;
+			break;
+		}
+	}
+	if (!found && (e = u_malloc(sizeof(MsgIdEntry) + len)) != NULL) {
+		if (shard->count >= set->max_per_shard)
+			shard_drop_oldest(shard);
+		else if (shard->count >= shard->nbuckets * 2)
+			shard_grow(shard);
+		memcpy(e->id, msgid, len + 1);
+		e->hash = hash;
+		e->seen = now;
+		e->newer = NULL;
+		e->chain = shard->buckets[bucket_of(shard, hash)];
+		shard->buckets[bucket_of(shard, hash)] = e;
+		if (shard->newest)
+			shard->newest->newer = e;
+		else
+			shard->oldest = e;
+		shard->newest = e;
+		shard->count++;
+	}
+	pthread_mutex_unlock(&shard->lock);
+	return found;
+}
+
+unsigned long wsman_msgid_set_count(WsmanMsgIdSet *set)
+{
+	unsigned long count = 0;
+	time_t now = time(NULL);
+	int i;
+
+	if (set == NULL)
+		return 0;
+	for (i = 0; i < MSGID_SHARDS; i++) {
+		pthread_mutex_lock(&set->shards[i].lock);
+		shard_expire(set, &set->shards[i], now);
+		count += set->shards[i].count;
+		pthread_mutex_unlock(&set->shards[i].lock);
+	}
+	return count;
+}
@@ -48,6 +48,7 @@
 #include "wsman-client-api.h"
 #include "wsman-soap.h"
 #include "wsman-xml.h"
+#include "wsman-xml-binding.h"
 #include "wsman-xml-serializer.h"
 
 #include "wsman-faults.h"
@@ -104,6 +105,7 @@ wsman_create_response_envelope(WsXmlDocH rqstDoc, const char *action)
 
 	WsXmlDocH doc = ws_xml_create_envelope();
 	WsXmlNodeH dstHeader, srcHeader, srcNode;
+	WsmanHeaderIndex *idx = wsman_get_header_index(rqstDoc);
 	if (wsman_is_identify_request(rqstDoc))
 		return doc;
 	if (!doc)
@@ -112,7 +114,8 @@ wsman_create_response_envelope(WsXmlDocH rqstDoc, const char *action)
 	dstHeader = ws_xml_get_soap_header(doc);
 	srcHeader = ws_xml_get_soap_header(rqstDoc);
 
-	srcNode = ws_xml_get_child(srcHeader, 0, XML_NS_ADDRESSING,
+	srcNode = idx ? idx->reply_to :
+		ws_xml_get_child(srcHeader, 0, XML_NS_ADDRESSING,
 			     WSA_REPLY_TO);
 	wsman_epr_from_request_to_response(dstHeader, srcNode);
 
@@ -120,8 +123,10 @@ wsman_create_response_envelope(WsXmlDocH rqstDoc, const char *action)
 		ws_xml_add_child(dstHeader, XML_NS_ADDRESSING, WSA_ACTION,
 				 action);
 	} else {
-		if ((srcNode = ws_xml_get_child(srcHeader, 0, XML_NS_ADDRESSING,
-				      WSA_ACTION)) != NULL) {
+		srcNode = idx ? idx->action :
+			ws_xml_get_child(srcHeader, 0, XML_NS_ADDRESSING,
+				      WSA_ACTION);
+		if (srcNode != NULL) {
 			if ((action = ws_xml_get_node_text(srcNode)) != NULL) {
 				size_t len = strlen(action) + sizeof(WSFW_RESPONSE_STR) + 2;
 				char *tmp = (char *) u_malloc(sizeof(char) * len);
@@ -135,8 +140,10 @@ wsman_create_response_envelope(WsXmlDocH rqstDoc, const char *action)
 		}
 	}
 
-	if ((srcNode = ws_xml_get_child(srcHeader, 0, XML_NS_ADDRESSING,
-					WSA_MESSAGE_ID)) != NULL) {
+	srcNode = idx ? idx->message_id :
+		ws_xml_get_child(srcHeader, 0, XML_NS_ADDRESSING,
+				 WSA_MESSAGE_ID);
+	if (srcNode != NULL) {
 		ws_xml_add_child(dstHeader, XML_NS_ADDRESSING, WSA_RELATES_TO,
 				 ws_xml_get_node_text(srcNode));
 	}
@@ -164,6 +171,113 @@ int wsman_check_identify(WsmanMessage * msg)
 	return ret;
 }
 
+struct __MuHeaderInfo {
+	char *ns;
+	char *name;
+};
+
+static int is_mu_header(const char *ns, const char *name)
+{
+	int i;
+	static struct __MuHeaderInfo s_Info[] = {
+		{XML_NS_ADDRESSING, WSA_TO},
+		{XML_NS_ADDRESSING, WSA_MESSAGE_ID},
+		{XML_NS_ADDRESSING, WSA_RELATES_TO},
+		{XML_NS_ADDRESSING, WSA_ACTION},
+		{XML_NS_ADDRESSING, WSA_REPLY_TO},
+		{XML_NS_ADDRESSING, WSA_FROM},
+		{XML_NS_WS_MAN, WSM_RESOURCE_URI},
+		{XML_NS_WS_MAN, WSM_SELECTOR_SET},
+		{XML_NS_WS_MAN, WSM_MAX_ENVELOPE_SIZE},
+		{XML_NS_WS_MAN, WSM_OPERATION_TIMEOUT},
+		{XML_NS_WS_MAN, WSM_FRAGMENT_TRANSFER},
+		{XML_NS_TRUST, WST_ISSUEDTOKENS},
+		{NULL, NULL}
+	};
+
+	for (i = 0; ns != NULL && s_Info[i].name != NULL; i++) {
+		if (!strcmp(ns, s_Info[i].ns) && !strcmp(name, s_Info[i].name))
+			return 1;
+	}
+	debug("mustUnderstand: %s:%s", !ns ? "null" : ns, name ? name : "NULL");
+	return 0;
+}
+
+/**
+ * Index the SOAP header of a request
+ * @param doc XML document
+ * @brief One walk over the header children instead of a namespace
+ * and name compare scan per lookup later on.
+ */
+static void wsman_index_headers(WsXmlDocH doc)
+{
+	WsmanHeaderIndex *idx;
+	WsXmlNodeH header = ws_xml_get_soap_header(doc);
+	WsXmlNodeH child, *slot;
+	char *soapNs, *ns, *name;
+
+	if (header == NULL)
+		return;
+	idx = u_zalloc(sizeof(WsmanHeaderIndex));
+	idx->header = header;
+	soapNs = ws_xml_get_node_name_ns(header);
+
+	for (child = xml_parser_get_first_child(header); child != NULL;
+	     child = xml_parser_get_next_child(child)) {
+		ns = ws_xml_get_node_name_ns(child);
+		name = ws_xml_get_node_local_name(child);
+		slot = NULL;
+		if (ns == NULL || name == NULL) {
+			/* unqualified, nothing we know */
+		} else if (!strcmp(ns, XML_NS_ADDRESSING)) {
+			if (!strcmp(name, WSA_ACTION))
+				slot = &idx->action;
+			else if (!strcmp(name, WSA_TO))
+				slot = &idx->to;
+			else if (!strcmp(name, WSA_MESSAGE_ID))
+				slot = &idx->message_id;
+			else if (!strcmp(name, WSA_REPLY_TO))
+				slot = &idx->reply_to;
+			else if (!strcmp(name, WSA_FAULT_TO))
+				slot = &idx->fault_to;
+		} else if (!strcmp(ns, XML_NS_WS_MAN)) {
+			if (!strcmp(name, WSM_RESOURCE_URI))
+				slot = &idx->resource_uri;
+			else if (!strcmp(name, WSM_SELECTOR_SET))
+				slot = &idx->selector_set;
+			else if (!strcmp(name, WSM_OPTION_SET))
+				slot = &idx->option_set;
+			else if (!strcmp(name, WSM_MAX_ENVELOPE_SIZE))
+				slot = &idx->max_envelope_size;
+			else if (!strcmp(name, WSM_OPERATION_TIMEOUT))
+				slot = &idx->operation_timeout;
+			else if (!strcmp(name, WSM_LOCALE))
+				slot = &idx->locale;
+			else if (!strcmp(name, WSM_FRAGMENT_TRANSFER))
+				slot = &idx->fragment_transfer;
+		}
+		if (slot != NULL && *slot == NULL)
+			*slot = child;
+
+		if (idx->not_understood == NULL &&
+		    ws_xml_find_attr_bool(child, soapNs, SOAP_MUST_UNDERSTAND) &&
+		    !is_mu_header(ns, name))
+			idx->not_understood = child;
+	}
+	doc->headers = idx;
+}
+
+/**
+ * Get the header index of a request
+ * @param doc XML document
+ * @return Header index, NULL if doc was not built by
+ * wsman_build_inbound_envelope()
+ */
+WsmanHeaderIndex *wsman_get_header_index(WsXmlDocH doc)
+{
+	return doc ? doc->headers : NULL;
+}
+
 /**
  * Buid Inbound Envelope
  * @param buf Message buffer
@@ -181,6 +295,7 @@ WsXmlDocH wsman_build_inbound_envelope(WsmanMessage * msg)
 	if (wsman_is_identify_request(doc)) {
 		wsman_set_message_flags(msg, FLAG_IDENTIFY_REQUEST);
 	}
+	wsman_index_headers(doc);
 	wsman_is_valid_envelope(msg, doc);
 	return doc;
 }
@@ -341,19 +456,23 @@ int wsman_is_valid_envelope(WsmanMessage * msg, WsXmlDocH doc)
 		goto cleanup;
 	} else {
 		if (!wsman_is_identify_request(doc) && !wsman_is_event_related_request(doc)) {
-			WsXmlNodeH resource_uri =
+			WsmanHeaderIndex *idx = wsman_get_header_index(doc);
+			WsXmlNodeH resource_uri = idx ? idx->resource_uri :
 			    ws_xml_get_child(header, 0,
 					     XML_NS_WS_MAN,
 					     WSM_RESOURCE_URI);
-			WsXmlNodeH action = ws_xml_get_child(header, 0,
-							     XML_NS_ADDRESSING,
-							     WSA_ACTION);
-			WsXmlNodeH reply = ws_xml_get_child(header, 0,
-							    XML_NS_ADDRESSING,
-							    WSA_REPLY_TO);
-			WsXmlNodeH to = ws_xml_get_child(header, 0,
-							 XML_NS_ADDRESSING,
-							 WSA_TO);
+			WsXmlNodeH action = idx ? idx->action :
+			    ws_xml_get_child(header, 0,
+					     XML_NS_ADDRESSING,
+					     WSA_ACTION);
+			WsXmlNodeH reply = idx ? idx->reply_to :
+			    ws_xml_get_child(header, 0,
+					     XML_NS_ADDRESSING,
+					     WSA_REPLY_TO);
+			WsXmlNodeH to = idx ? idx->to :
+			    ws_xml_get_child(header, 0,
+					     XML_NS_ADDRESSING,
+					     WSA_TO);
 			if (!resource_uri) {
 				wsman_set_fault(msg,
 						WSA_DESTINATION_UNREACHABLE,
@@ -528,6 +647,10 @@ int wsman_parse_enum_request(WsContextH cntx,
 		return 0;
         }
 
+	if (ws_xml_get_child(ws_xml_get_soap_header(doc), 0,
+			     XML_NS_WS_MAN, WSM_REQUEST_TOTAL) != NULL)
+		enumInfo->flags |= WSMAN_ENUMINFO_EST_COUNT;
+
 	node = ws_xml_get_soap_body(doc);
 	if (node && (node = ws_xml_get_child(node, 0,
 					XML_NS_ENUMERATION,
@@ -769,9 +892,12 @@ wsman_get_option_set(WsContextH cntx, WsXmlDocH doc,
 			return NULL;
 	}
 
-	node = ws_xml_get_soap_header(doc);
-	if (node && (node = ws_xml_get_child(node, 0,
-					XML_NS_WS_MAN, WSM_OPTION_SET))) {
+	if (doc->headers)
+		node = doc->headers->option_set;
+	else
+		node = ws_xml_get_child(ws_xml_get_soap_header(doc), 0,
+					XML_NS_WS_MAN, WSM_OPTION_SET);
+	if (node) {
 		while ((option = ws_xml_get_child(node, index++, XML_NS_WS_MAN,
 						WSM_OPTION))) {
 			char *attrVal = ws_xml_find_attr_value(option, NULL,
@@ -828,8 +954,11 @@ unsigned long wsman_get_max_envelope_size(WsContextH cntx, WsXmlDocH doc)
 	if (doc == NULL)
 		doc = cntx->indoc;
 	header = ws_xml_get_soap_header(doc);
-	maxsize = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
-			     WSM_MAX_ENVELOPE_SIZE);
+	if (doc && doc->headers)
+		maxsize = doc->headers->max_envelope_size;
+	else
+		maxsize = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
+				     WSM_MAX_ENVELOPE_SIZE);
 	mu = ws_xml_find_attr_value(maxsize, XML_NS_SOAP_1_2,
 				    SOAP_MUST_UNDERSTAND);
 	if (mu != NULL && strcmp(mu, "true") == 0) {
@@ -846,9 +975,13 @@ char * wsman_get_fragment_string(WsContextH cntx, WsXmlDocH doc)
 	char *mu = NULL;
 	if(doc == NULL)
 		doc = cntx->indoc;
-	header = ws_xml_get_soap_header(doc);
-	n = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
-			     WSM_FRAGMENT_TRANSFER);
+	if (doc && doc->headers) {
+		n = doc->headers->fragment_transfer;
+	} else {
+		header = ws_xml_get_soap_header(doc);
+		n = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
+				     WSM_FRAGMENT_TRANSFER);
+	}
 	if (n != NULL) {
 		mu = ws_xml_find_attr_value(n, XML_NS_SOAP_1_2,
 					    SOAP_MUST_UNDERSTAND);
@@ -935,9 +1068,13 @@ wsman_get_resource_uri(WsContextH cntx, WsXmlDocH doc)
 			return NULL;
 	}
 
-	header = ws_xml_get_soap_header(doc);
-	node = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
-				WSM_RESOURCE_URI);
+	if (doc->headers) {
+		node = doc->headers->resource_uri;
+	} else {
+		header = ws_xml_get_soap_header(doc);
+		node = ws_xml_get_child(header, 0, XML_NS_WS_MAN,
+					WSM_RESOURCE_URI);
+	}
 	val = (!node) ? NULL : ws_xml_get_node_text(node);
 	return val;
 }
@@ -1187,7 +1324,9 @@ wsman_get_selector(WsContextH cntx,
 		doc = cntx->indoc;
 	if (doc) {
 		WsXmlNodeH header = ws_xml_get_soap_header(doc);
-		WsXmlNodeH node = ws_xml_get_child(header, index, XML_NS_WS_MAN,
+		WsXmlNodeH node = (index == 0 && doc->headers) ?
+			doc->headers->selector_set :
+			ws_xml_get_child(header, index, XML_NS_WS_MAN,
 				     WSM_SELECTOR_SET);
 
 		if (node) {
@@ -1220,9 +1359,9 @@ char *wsman_get_action(WsContextH cntx, WsXmlDocH doc)
 		doc = cntx->indoc;
 	}
 	if (doc) {
-		WsXmlNodeH header = ws_xml_get_soap_header(doc);
-		WsXmlNodeH node = ws_xml_get_child(header, 0, XML_NS_ADDRESSING,
-				     WSA_ACTION);
+		WsXmlNodeH node = doc->headers ? doc->headers->action :
+			ws_xml_get_child(ws_xml_get_soap_header(doc), 0,
+				     XML_NS_ADDRESSING, WSA_ACTION);
 		val = (!node) ? NULL : ws_xml_get_node_text(node);
 	}
 	return val;
@@ -1274,7 +1413,8 @@ wsman_set_estimated_total(WsXmlDocH in_doc,
 		if (out_doc) {
 			WsXmlNodeH response_header =
 			    ws_xml_get_soap_header(out_doc);
-			if (enumInfo->totalItems >= 0)
+			if (enumInfo->totalItems >= 0 &&
+			    !(enumInfo->flags & WSMAN_ENUMINFO_TOTAL_UNKNOWN))
 				ws_xml_add_child_format(response_header,
 							XML_NS_WS_MAN,
 							WSM_TOTAL_ESTIMATE,
@@ -1322,9 +1462,13 @@ int wsman_is_identify_request(WsXmlDocH doc)
 
 int wsman_is_event_related_request(WsXmlDocH doc)
 {
-	WsXmlNodeH node = ws_xml_get_soap_header(doc);
+	WsXmlNodeH node;
 	char *action = NULL;
-	node = ws_xml_get_child(node, 0, XML_NS_ADDRESSING, WSA_ACTION);
+	if (doc && doc->headers)
+		node = doc->headers->action;
+	else
+		node = ws_xml_get_child(ws_xml_get_soap_header(doc), 0,
+					XML_NS_ADDRESSING, WSA_ACTION);
 	action = ws_xml_get_node_text(node);
 	if (!action)
 		return 0;
@@ -74,6 +74,18 @@ wsman_soap_message_new()
     return wsman_msg;
 }
 
+/*
+ * Hand a filled request buffer over to the message, no copy is made.
+ * The message owns the buffer afterwards.
+ */
+void
+wsman_soap_message_set_request(WsmanMessage *wsman_msg, u_buf_t *request)
+{
+    if (wsman_msg->request)
+        u_buf_free(wsman_msg->request);
+    wsman_msg->request = request;
+}
+
 void
 wsman_soap_message_destroy(WsmanMessage* wsman_msg)
 {
@@ -143,19 +143,137 @@ free_hentry_func(hnode_t * n, void *arg)
 }
 
 
+/*
+ * Enumeration contexts of the SOAP runtime context, by enumeration
+ * context ID. The table is split in stripes with a lock each, so that
+ * Pulls on different contexts do not wait for each other nor for the
+ * expiry scan, and none of them takes the soap lock.
+ */
+#define ENUMINFO_STRIPES 32	/* Power of 2 */
+
+struct __WsEnumInfoTable {
+	struct {
+		pthread_mutex_t lock;
+		/* a read-ahead or a spill left a context */
+		pthread_cond_t settled;
+		hash_t *infos;
+	} stripes[ENUMINFO_STRIPES];
+	/* Budget for the items endpoints hold between Pulls (0: none),
+	 * see enforce_enum_memory() */
+	unsigned long mem_limit;	/* per context */
+	unsigned long mem_total_limit;	/* all contexts */
+	pthread_mutex_t mem_lock;
+	unsigned long mem_total;	/* sum of memCounted */
+	char *spill_dir;
+	/* Read-ahead of the next batch after each Pull, see
+	 * prefetch_enuminfo() */
+	pthread_mutex_t prefetch_lock;
+	pthread_cond_t prefetch_wanted;
+	list_t *prefetch_queue;		/* enumIds */
+	pthread_t *prefetch_threads;
+	int prefetch_nthreads;
+	int prefetch_render;
+	int prefetch_stop;
+};
+
+static WsEnumInfoTable *
+enuminfo_table_new(void)
+{
+	WsEnumInfoTable *t = u_zalloc(sizeof(WsEnumInfoTable));
+	int i;
+
+	for (i = 0; i < ENUMINFO_STRIPES; i++) {
+		pthread_mutex_init(&t->stripes[i].lock, NULL);
+		pthread_cond_init(&t->stripes[i].settled, NULL);
+		t->stripes[i].infos = hash_create(HASHCOUNT_T_MAX, NULL, NULL);
+		hash_set_allocator(t->stripes[i].infos, NULL,
+				   free_hentry_func, NULL);
+	}
+	pthread_mutex_init(&t->mem_lock, NULL);
+	pthread_mutex_init(&t->prefetch_lock, NULL);
+	pthread_cond_init(&t->prefetch_wanted, NULL);
+	t->prefetch_queue = list_create(LISTCOUNT_T_MAX);
+	return t;
+}
+
+static void
+enuminfo_table_free(WsEnumInfoTable *t)
+{
+	int i;
+
+	if (t == NULL)
+		return;
+	pthread_mutex_lock(&t->prefetch_lock);
+	t->prefetch_stop = 1;
+	pthread_cond_broadcast(&t->prefetch_wanted);
+	pthread_mutex_unlock(&t->prefetch_lock);
+	for (i = 0; i < t->prefetch_nthreads; i++)
+		pthread_join(t->prefetch_threads[i], NULL);
+	u_free(t->prefetch_threads);
+	while (!list_isempty(t->prefetch_queue)) {
+		lnode_t *node = list_del_first(t->prefetch_queue);
+		u_free(lnode_get(node));
+		lnode_destroy(node);
+	}
+	list_destroy(t->prefetch_queue);
+	pthread_cond_destroy(&t->prefetch_wanted);
+	pthread_mutex_destroy(&t->prefetch_lock);
+	for (i = 0; i < ENUMINFO_STRIPES; i++) {
+		hash_free(t->stripes[i].infos);
+		pthread_cond_destroy(&t->stripes[i].settled);
+		pthread_mutex_destroy(&t->stripes[i].lock);
+	}
+	pthread_mutex_destroy(&t->mem_lock);
+	u_free(t->spill_dir);
+	u_free(t);
+}
+
+/* Stripe of an enumeration context ID */
+static int
+enuminfo_stripe(const char *enumId)
+{
+	return wsman_id_hash(enumId) & (ENUMINFO_STRIPES - 1);
+}
+
+#define ENUMINFO_LOCK(t, i)	pthread_mutex_lock(&(t)->stripes[i].lock)
+#define ENUMINFO_UNLOCK(t, i)	pthread_mutex_unlock(&(t)->stripes[i].lock)
+
+/* Bring the table total up to date with what the endpoint reported */
+static void
+account_enuminfo(WsEnumInfoTable *t, WsEnumerateInfo *enumInfo)
+{
+	pthread_mutex_lock(&t->mem_lock);
+	t->mem_total = t->mem_total - enumInfo->memCounted + enumInfo->memSize;
+	enumInfo->memCounted = enumInfo->memSize;
+	pthread_mutex_unlock(&t->mem_lock);
+}
+
+static void
+unaccount_enuminfo(WsEnumInfoTable *t, WsEnumerateInfo *enumInfo)
+{
+	pthread_mutex_lock(&t->mem_lock);
+	t->mem_total -= enumInfo->memCounted;
+	enumInfo->memCounted = 0;
+	pthread_mutex_unlock(&t->mem_lock);
+}
+
 static void
 remove_locked_enuminfo(WsContextH cntx,
                        WsEnumerateInfo * enumInfo)
 {
-	u_lock(cntx->soap);
+	WsEnumInfoTable *t = cntx->enuminfos;
+	int i = enuminfo_stripe(enumInfo->enumId);
+
+	ENUMINFO_LOCK(t, i);
 	if (!(enumInfo->flags & WSMAN_ENUMINFO_INWORK_FLAG)) {
 		error("locked enuminfo unlocked");
-		u_unlock(cntx->soap);
+		ENUMINFO_UNLOCK(t, i);
 		return;
 	}
-	hash_delete_free(cntx->enuminfos,
-	             hash_lookup(cntx->enuminfos, enumInfo->enumId));
-	u_unlock(cntx->soap);
+	hash_delete_free(t->stripes[i].infos,
+	             hash_lookup(t->stripes[i].infos, enumInfo->enumId));
+	ENUMINFO_UNLOCK(t, i);
+	unaccount_enuminfo(t, enumInfo);
 }
 
 #ifdef ENABLE_EVENTING_SUPPORT
@@ -294,6 +412,8 @@ destroy_enuminfo(WsEnumerateInfo * enumInfo)
 	u_free(enumInfo->encoding);
 	if (enumInfo->filter)
 		filter_destroy(enumInfo->filter);
+	if (enumInfo->spillFile)
+		fclose(enumInfo->spillFile);
 	u_free(enumInfo);
 }
 
@@ -342,15 +462,20 @@ insert_enum_info(WsContextH cntx,
 		WsEnumerateInfo *enumInfo)
 {
 	struct timeval tv;
+	WsEnumInfoTable *t = cntx->enuminfos;
+	int i = enuminfo_stripe(enumInfo->enumId);
 	int retVal = 1;
 
-	u_lock(cntx->soap);
 	gettimeofday(&tv, NULL);
+	ENUMINFO_LOCK(t, i);
 	enumInfo->timeStamp = tv.tv_sec;
-	if (create_context_entry(cntx->enuminfos, enumInfo->enumId, enumInfo)) {
+	if (create_context_entry(t->stripes[i].infos, enumInfo->enumId,
+				 enumInfo)) {
 		retVal = 0;
 	}
-	u_unlock(cntx->soap);
+	ENUMINFO_UNLOCK(t, i);
+	if (retVal == 0)
+		account_enuminfo(t, enumInfo);
 	return retVal;
 }
 
@@ -365,7 +490,9 @@ get_locked_enuminfo(WsContextH cntx,
 {
 	hnode_t *hn;
 	WsEnumerateInfo *eInfo = NULL;
+	WsEnumInfoTable *t = cntx->enuminfos;
 	char *enumId = NULL;
+	int i;
 	WsXmlNodeH node = ws_xml_get_soap_body(doc);
 
 	if (node && (node = ws_xml_get_child(node,
@@ -382,8 +509,16 @@ get_locked_enuminfo(WsContextH cntx,
 		status->fault_code = WSEN_INVALID_ENUMERATION_CONTEXT;
 		return NULL;
 	}
-	u_lock(cntx->soap);
-	hn = hash_lookup(cntx->enuminfos, enumId);
+	i = enuminfo_stripe(enumId);
+	ENUMINFO_LOCK(t, i);
+	hn = hash_lookup(t->stripes[i].infos, enumId);
+	/* a read-ahead or a spill is no reason to fail the request, wait */
+	while (hn && (((WsEnumerateInfo *)hnode_get(hn))->flags &
+		      (WSMAN_ENUMINFO_PREFETCH | WSMAN_ENUMINFO_SPILLING))) {
+		pthread_cond_wait(&t->stripes[i].settled,
+				  &t->stripes[i].lock);
+		hn = hash_lookup(t->stripes[i].infos, enumId);
+	}
 	if (hn) {
 		eInfo = (WsEnumerateInfo *)hnode_get(hn);
 		if (strcmp(eInfo->enumId, enumId)) {
@@ -404,7 +539,7 @@ get_locked_enuminfo(WsContextH cntx,
 	if (status->fault_code != WSMAN_RC_OK) {
 		eInfo = NULL;
 	}
-	u_unlock(cntx->soap);
+	ENUMINFO_UNLOCK(t, i);
 	return eInfo;
 }
 
@@ -412,16 +547,225 @@ static void
 unlock_enuminfo(WsContextH cntx, WsEnumerateInfo *enumInfo)
 {
 	struct timeval tv;
+	WsEnumInfoTable *t = cntx->enuminfos;
+	int i = enuminfo_stripe(enumInfo->enumId);
+
 	gettimeofday(&tv, NULL);
-	u_lock(cntx->soap);
+	ENUMINFO_LOCK(t, i);
 	if (!(enumInfo->flags & WSMAN_ENUMINFO_INWORK_FLAG)) {
 		error("locked enuminfo unlocked");
-		u_unlock(cntx->soap);
+		ENUMINFO_UNLOCK(t, i);
 		return;
 	}
 	enumInfo->flags &= ~WSMAN_ENUMINFO_INWORK_FLAG;
 	enumInfo->timeStamp = tv.tv_sec;
-	u_unlock(cntx->soap);
+	ENUMINFO_UNLOCK(t, i);
+	account_enuminfo(t, enumInfo);
+}
+
+/* Temporary file for spilled items, unlinked right away */
+static FILE *
+enuminfo_spill_file(WsEnumInfoTable *t)
+{
+	char *path = u_strdup_printf("%s/wsman-enum-XXXXXX",
+			t->spill_dir ? t->spill_dir : "/tmp");
+	FILE *f = NULL;
+	int fd = mkstemp(path);
+
+	if (fd < 0) {
+		error("could not create %s: %s", path, strerror(errno));
+	} else {
+		unlink(path);
+		if ((f = fdopen(fd, "w+")) == NULL)
+			close(fd);
+	}
+	u_free(path);
+	return f;
+}
+
+/*
+ * Have the endpoint move the pending items of a context in work to a
+ * temporary file, the following Pulls read them back from there.
+ */
+static int
+spill_enuminfo(WsEnumInfoTable *t, WsEnumerateInfo *enumInfo)
+{
+	FILE *f;
+
+	if (enumInfo->spillproc == NULL || enumInfo->spillFile ||
+			enumInfo->memSize == 0)
+		return 0;
+	if ((f = enuminfo_spill_file(t)) == NULL)
+		return 0;
+	debug("spilling %s, %lu bytes", enumInfo->enumId, enumInfo->memSize);
+	if (enumInfo->spillproc(enumInfo, f)) {
+		error("could not spill %s", enumInfo->enumId);
+		fclose(f);
+		return 0;
+	}
+	enumInfo->spillFile = f;
+	enumInfo->memSize = 0;
+	return 1;
+}
+
+/*
+ * While the contexts hold more than mem_total_limit bytes, spill the
+ * least recently used one that is not in work.  Run from the timeouts
+ * manager, a Pull coming meanwhile waits for the spill to finish, see
+ * get_locked_enuminfo().
+ */
+static void
+enforce_enum_memory(WsContextH cntx)
+{
+	WsEnumInfoTable *t = cntx->enuminfos;
+	WsEnumerateInfo *enumInfo, *coldest;
+	char enumId[EUIDLEN];
+	unsigned long total;
+	hnode_t *hn;
+	hscan_t hs;
+	int i, spilled;
+
+	if (t->mem_total_limit == 0)
+		return;
+	for (;;) {
+		pthread_mutex_lock(&t->mem_lock);
+		total = t->mem_total;
+		pthread_mutex_unlock(&t->mem_lock);
+		if (total <= t->mem_total_limit)
+			break;
+
+		coldest = NULL;
+		for (i = 0; i < ENUMINFO_STRIPES; i++) {
+			ENUMINFO_LOCK(t, i);
+			hash_scan_begin(&hs, t->stripes[i].infos);
+			while ((hn = hash_scan_next(&hs))) {
+				enumInfo = (WsEnumerateInfo *)hnode_get(hn);
+				if ((enumInfo->flags & WSMAN_ENUMINFO_INWORK_FLAG) ||
+				    enumInfo->memSize == 0 ||
+				    enumInfo->spillproc == NULL ||
+				    enumInfo->spillFile)
+					continue;
+				if (coldest == NULL ||
+				    enumInfo->timeStamp < coldest->timeStamp) {
+					coldest = enumInfo;
+					strncpy(enumId, enumInfo->enumId, EUIDLEN);
+				}
+			}
+			ENUMINFO_UNLOCK(t, i);
+		}
+		if (coldest == NULL)
+			break;
+
+		/* it may have gone or been pulled meanwhile */
+		i = enuminfo_stripe(enumId);
+		ENUMINFO_LOCK(t, i);
+		hn = hash_lookup(t->stripes[i].infos, enumId);
+		enumInfo = hn ? (WsEnumerateInfo *)hnode_get(hn) : NULL;
+		if (enumInfo && (enumInfo->flags & WSMAN_ENUMINFO_INWORK_FLAG))
+			enumInfo = NULL;
+		if (enumInfo)
+			enumInfo->flags |= WSMAN_ENUMINFO_INWORK_FLAG |
+				WSMAN_ENUMINFO_SPILLING;
+		ENUMINFO_UNLOCK(t, i);
+		if (enumInfo == NULL)
+			continue;
+
+		spilled = spill_enuminfo(t, enumInfo);
+		account_enuminfo(t, enumInfo);
+		/* not unlock_enuminfo(), spilling does not make it any younger */
+		ENUMINFO_LOCK(t, i);
+		enumInfo->flags &= ~(WSMAN_ENUMINFO_INWORK_FLAG |
+				     WSMAN_ENUMINFO_SPILLING);
+		pthread_cond_broadcast(&t->stripes[i].settled);
+		ENUMINFO_UNLOCK(t, i);
+		if (!spilled)
+			break;
+	}
+}
+
+/*
+ * Have the endpoint read the next batch of a context ahead while the
+ * client is busy with the last one.  Only the budget of the context
+ * is left for it, and the Pull that comes meanwhile waits, see
+ * get_locked_enuminfo().
+ */
+static void
+prefetch_enuminfo(WsContextH cntx, const char *enumId)
+{
+	WsEnumInfoTable *t = cntx->enuminfos;
+	WsEnumerateInfo *enumInfo = NULL;
+	hnode_t *hn;
+	int i = enuminfo_stripe(enumId);
+
+	ENUMINFO_LOCK(t, i);
+	hn = hash_lookup(t->stripes[i].infos, enumId);
+	if (hn)
+		enumInfo = (WsEnumerateInfo *)hnode_get(hn);
+	if (enumInfo && ((enumInfo->flags & WSMAN_ENUMINFO_INWORK_FLAG) ||
+			 enumInfo->prefetchproc == NULL ||
+			 enumInfo->spillFile ||
+			 (t->mem_limit && enumInfo->memSize >= t->mem_limit)))
+		enumInfo = NULL;
+	if (enumInfo)
+		enumInfo->flags |= WSMAN_ENUMINFO_INWORK_FLAG |
+			WSMAN_ENUMINFO_PREFETCH;
+	ENUMINFO_UNLOCK(t, i);
+	if (enumInfo == NULL)
+		return;
+
+	debug("prefetching %s", enumId);
+	enumInfo->prefetchproc(enumInfo, t->prefetch_render);
+	if (t->mem_limit && enumInfo->memSize > t->mem_limit)
+		spill_enuminfo(t, enumInfo);
+	account_enuminfo(t, enumInfo);
+
+	/* not unlock_enuminfo(), reading ahead does not make it any younger */
+	ENUMINFO_LOCK(t, i);
+	enumInfo->flags &= ~(WSMAN_ENUMINFO_INWORK_FLAG |
+			     WSMAN_ENUMINFO_PREFETCH);
+	pthread_cond_broadcast(&t->stripes[i].settled);
+	ENUMINFO_UNLOCK(t, i);
+}
+
+static void *
+enum_prefetch_worker(void *arg)
+{
+	WsContextH cntx = (WsContextH) arg;
+	WsEnumInfoTable *t = cntx->enuminfos;
+	lnode_t *node;
+	char *enumId;
+
+	for (;;) {
+		pthread_mutex_lock(&t->prefetch_lock);
+		while (!t->prefetch_stop && list_isempty(t->prefetch_queue))
+			pthread_cond_wait(&t->prefetch_wanted,
+					  &t->prefetch_lock);
+		if (t->prefetch_stop) {
+			pthread_mutex_unlock(&t->prefetch_lock);
+			break;
+		}
+		node = list_del_first(t->prefetch_queue);
+		pthread_mutex_unlock(&t->prefetch_lock);
+		enumId = (char *)lnode_get(node);
+		lnode_destroy(node);
+		prefetch_enuminfo(cntx, enumId);
+		u_free(enumId);
+	}
+	return NULL;
+}
+
+/* Queue the read-ahead of a context whose response just went out */
+static void
+schedule_enum_prefetch(WsContextH cntx, const char *enumId)
+{
+	WsEnumInfoTable *t = cntx->enuminfos;
+
+	if (t->prefetch_nthreads == 0)
+		return;
+	pthread_mutex_lock(&t->prefetch_lock);
+	list_append(t->prefetch_queue, lnode_create(u_strdup(enumId)));
+	pthread_cond_signal(&t->prefetch_wanted);
+	pthread_mutex_unlock(&t->prefetch_lock);
 }
 
 static void
@@ -438,12 +782,10 @@ ws_clear_context_entries(WsContextH hCntx)
 static void
 ws_clear_context_enuminfos(WsContextH hCntx)
 {
-	hash_t *h;
 	if (!hCntx) {
 		return;
 	}
-	h = hCntx->enuminfos;
-	hash_free(h);
+	enuminfo_table_free(hCntx->enuminfos);
 }
 
 callback_t *
@@ -474,9 +816,9 @@ ws_initialize_context(WsContextH cntx, SoapH soap)
 	cntx->entries = hash_create(HASHCOUNT_T_MAX, NULL, NULL);
 	hash_set_allocator(cntx->entries, NULL, free_hentry_func, NULL);
 
-	cntx->enuminfos = hash_create(HASHCOUNT_T_MAX, NULL, NULL);
+	/* Only the runtime context keeps enumeration contexts */
+	cntx->enuminfos = NULL;
 	cntx->subscriptionMemList = list_create(LISTCOUNT_T_MAX);
-	hash_set_allocator(cntx->enuminfos, NULL, free_hentry_func, NULL);
 	cntx->owner = 1;
 	cntx->soap = soap;
 	cntx->serializercntx = ws_serializer_init();
@@ -502,18 +844,23 @@ ws_soap_initialize()
 		return NULL;
 	}
 	soap->cntx = ws_create_context(soap);
+	soap->cntx->enuminfos = enuminfo_table_new();
 
 	soap->inboundFilterList = NULL;
 	soap->outboundFilterList = NULL;
 	soap->dispatchList = NULL;
-	soap->processedMsgIdList = NULL;
+	soap->processedMsgIds = wsman_msgid_set_new(WSMAN_MSGID_WINDOW,
+						    WSMAN_MSGID_MAX);
+	if (soap->processedMsgIds == NULL)
+		error("no memory for MessageIDs, duplicates go undetected");
 
 	u_init_lock(soap);
 	u_init_lock(&soap->lockSubs);
 	ws_xml_parser_initialize();
 
+	/* MaxEnvelopeSize is enforced by the dispatcher once the response
+	 * is serialized, outbound_control_header_filter would dump it twice */
 	soap_add_filter(soap, outbound_addressing_filter, NULL, 0);
-	soap_add_filter(soap, outbound_control_header_filter, NULL, 0);
 	return soap;
 }
 
@@ -524,6 +871,49 @@ ws_set_context_enumIdleTimeout(WsContextH cntx,
 	cntx->enumIdleTimeout = timeout;
 }
 
+void
+ws_set_context_msgIdWindow(WsContextH cntx,
+                           unsigned long window)
+{
+	wsman_msgid_set_window(cntx->soap->processedMsgIds, window);
+}
+
+void
+ws_set_context_enumMemoryLimits(WsContextH cntx,
+                                unsigned long context_limit,
+                                unsigned long total_limit,
+                                const char *spill_dir)
+{
+	WsEnumInfoTable *t = cntx->enuminfos;
+
+	t->mem_limit = context_limit;
+	t->mem_total_limit = total_limit;
+	u_free(t->spill_dir);
+	t->spill_dir = u_strdup(spill_dir ? spill_dir : "/tmp");
+}
+
+void
+ws_set_context_enumPrefetch(WsContextH cntx,
+                            int threads, int render)
+{
+	WsEnumInfoTable *t = cntx->enuminfos;
+	int i;
+
+	if (t->prefetch_nthreads || threads <= 0)
+		return;
+	t->prefetch_render = render;
+	t->prefetch_threads = u_zalloc(threads * sizeof(pthread_t));
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&t->prefetch_threads[i], NULL,
+				   enum_prefetch_worker, cntx)) {
+			error("could not start prefetch thread: %s",
+			      strerror(errno));
+			break;
+		}
+	}
+	t->prefetch_nthreads = i;
+}
+
 
 
 WsContextH
@@ -563,6 +953,7 @@ ws_create_runtime(list_t * interfaces)
 		}
 		node = list_next(interfaces, node);
 	}
+	dispInfo->routes = wsman_dispatcher_routes_new(dispInfo);
 	ws_register_dispatcher(soap->cntx, wsman_dispatcher, dispInfo);
 	return soap->cntx;
 }
@@ -921,16 +1312,20 @@ unsigned long wsman_get_maxsize_from_op(SoapOpH op)
 
 static
 unsigned long get_total_enum_context(WsContextH cntx){
-        hscan_t hs;
-        u_lock(cntx->soap);
-        hash_scan_begin(&hs, cntx->enuminfos);
-        unsigned long total = hash_count(hs.hash_table);
-        u_unlock(cntx->soap);
+        WsEnumInfoTable *t = cntx->enuminfos;
+        unsigned long total = 0;
+        int i;
+
+        for (i = 0; i < ENUMINFO_STRIPES; i++) {
+                ENUMINFO_LOCK(t, i);
+                total += hash_count(t->stripes[i].infos);
+                ENUMINFO_UNLOCK(t, i);
+        }
         return total;
 }
 
 /**
- * The following extern methods are defined in wsmand-daemon.c,
+ * The following extern methods are defined in wsmand-admission.c,
  * which is compiled into openwsmand binary, which in turn links
  * to libwsman.la. So when a call is made to the following methods
  * from the openwsmand binary, they should be present.
@@ -941,10 +1336,8 @@ unsigned long get_total_enum_context(WsContextH cntx){
  * preset, hence marking them as weak symbols and testing to see
  * if they are resolved before using them.
  */
-#pragma weak wsmand_options_get_max_threads
-extern int wsmand_options_get_max_threads(void);
-#pragma weak wsmand_options_get_max_connections_per_thread
-extern int wsmand_options_get_max_connections_per_thread(void);
+#pragma weak wsmand_admission_enum_full
+extern int wsmand_admission_enum_full(unsigned long contexts);
 
 /**
  * Enumeration Stub for processing enumeration requests
@@ -971,26 +1364,11 @@ wsenum_enumerate_stub(SoapOpH op,
 
 	WsXmlDocH       _doc = soap_get_op_doc(op, 1);
 	WsContextH      epcntx;
+	char            enumId[EUIDLEN] = "";
 
-        int max_threads = 0;
-        int max_connections_per_thread = 0;
-        int(* fptr)(void);
-        if((fptr = wsmand_options_get_max_threads) != 0){
-                max_threads = (* fptr)();
-                if((fptr = wsmand_options_get_max_connections_per_thread) != 0){
-                        max_connections_per_thread = (* fptr)();
-                }
-                else{
-                        debug("Could not resolve wsmand_options_get_max_connections_per_thread");
-                        max_threads=0;
-                }
-        }
-        else{
-                debug("Could not resolve wsman_options_get_max_threads");
-        }
-
-        if(max_threads){
-                if(get_total_enum_context(ws_get_soap_context(soap)) >= (max_threads * max_connections_per_thread)){
+        int(* full)(unsigned long);
+        if((full = wsmand_admission_enum_full) != 0){
+                if((* full)(get_total_enum_context(ws_get_soap_context(soap)))){
                         debug("enum context queue is full, we wait till some expire or are cleared");
                         doc = wsman_generate_fault(_doc, WSMAN_QUOTA_LIMIT, OWSMAN_NO_DETAILS,
                                     "The service is busy servicing other requests. Try later.");
@@ -1000,6 +1378,9 @@ wsenum_enumerate_stub(SoapOpH op,
                         return 1;
                 }
         }
+        else{
+                debug("Could not resolve wsmand_admission_enum_full");
+        }
 
 	epcntx = ws_create_ep_context(soap, _doc);
 	wsman_status_init(&status);
@@ -1048,7 +1429,14 @@ wsenum_enumerate_stub(SoapOpH op,
 	} else {
 		ws_serialize_str(epcntx->serializercntx, resp_node, enumInfo->enumId,
 			    XML_NS_ENUMERATION, WSENUM_ENUMERATION_CONTEXT, 0);
+		if (soapCntx->enuminfos->mem_limit &&
+		    enumInfo->memSize > soapCntx->enuminfos->mem_limit)
+			spill_enuminfo(soapCntx->enuminfos, enumInfo);
+		if (enumInfo->prefetchproc)
+			strncpy(enumId, enumInfo->enumId, EUIDLEN);
 		insert_enum_info(soapCntx, enumInfo);
+		if (enumId[0])
+			schedule_enum_prefetch(soapCntx, enumId);
 	}
 
 DONE:
@@ -1128,6 +1516,7 @@ wsenum_pull_stub(SoapOpH op, void *appData,
 	int retVal = 0, locked = 0;
 	WsXmlDocH doc = NULL;
 	char *enumId = NULL;
+	char prefetchId[EUIDLEN] = "";
 
 	WsXmlDocH _doc = soap_get_op_doc(op, 1);
 	WsEnumerateInfo *enumInfo;
@@ -1171,6 +1560,8 @@ wsenum_pull_stub(SoapOpH op, void *appData,
 			 typeInfo, ep->respName, (char *) ep->data, NULL, 1);
 		ws_serializer_free_mem(soapCntx->serializercntx,
 			enumInfo->pullResultPtr, typeInfo);
+		if (enumInfo->prefetchproc)
+			strncpy(prefetchId, enumInfo->enumId, EUIDLEN);
 	} else {
 		/*
 		ws_serialize_str(soapCntx, node, NULL,
@@ -1186,6 +1577,8 @@ wsenum_pull_stub(SoapOpH op, void *appData,
 DONE:
 	if (locked) {
 		unlock_enuminfo(soapCntx, enumInfo);
+		if (prefetchId[0])
+			schedule_enum_prefetch(soapCntx, prefetchId);
 	}
 	if (doc) {
 		soap_set_op_doc(op, doc, 0);
@@ -1212,6 +1605,7 @@ wsenum_pull_direct_stub(SoapOpH op,
 	int             retVal = 0;
 	WsXmlDocH       _doc = soap_get_op_doc(op, 1);
 	int locked = 0;
+	char prefetchId[EUIDLEN] = "";
 	WsEnumerateInfo *enumInfo;
 	WsSubscribeInfo *subsInfo = NULL;
 	wsman_status_init(&status);
@@ -1263,6 +1657,12 @@ wsenum_pull_direct_stub(SoapOpH op,
 			        /* add Context before Items to comply to WS-Enumeration xsd */
 				ws_xml_add_prev_sibling(items, XML_NS_ENUMERATION,
 							WSENUM_ENUMERATION_CONTEXT, enumInfo->enumId);
+				if (soapCntx->enuminfos->mem_limit &&
+				    enumInfo->memSize > soapCntx->enuminfos->mem_limit)
+					spill_enuminfo(soapCntx->enuminfos, enumInfo);
+				if (enumInfo->prefetchproc)
+					strncpy(prefetchId, enumInfo->enumId,
+						EUIDLEN);
 			}
 		}
 	}
@@ -1317,6 +1717,8 @@ wsenum_pull_direct_stub(SoapOpH op,
 cleanup:
 	if (locked) {
 		unlock_enuminfo(soapCntx, enumInfo);
+		if (prefetchId[0])
+			schedule_enum_prefetch(soapCntx, prefetchId);
 	}
 	if (doc) {
 		soap_set_op_doc(op, doc, 0);
@@ -1334,45 +1736,51 @@ wsman_get_expired_enuminfos(WsContextH cntx)
 	hnode_t        *hn;
 	hscan_t         hs;
 	WsEnumerateInfo *enumInfo;
+	WsEnumInfoTable *t = cntx->enuminfos;
 	struct timeval tv;
 	unsigned long mytime;
 	unsigned long aeit = cntx->enumIdleTimeout;
+	int i;
 
 	if (aeit == 0) {
 		return NULL;
 	}
 	gettimeofday(&tv, NULL);
 	mytime = tv.tv_sec;
-	u_lock(cntx->soap);
-	if (hash_isempty(cntx->enuminfos)) {
-		u_unlock(cntx->soap);
-		return NULL;
-	}
-	hash_scan_begin(&hs, cntx->enuminfos);
-	while ((hn = hash_scan_next(&hs))) {
-		enumInfo = (WsEnumerateInfo *)hnode_get(hn);
-		if (enumInfo->flags & WSMAN_ENUMINFO_INWORK_FLAG) {
-			debug("Enum in work: %s", enumInfo->enumId);
+	/* One stripe at a time, requests on the others go on meanwhile */
+	for (i = 0; i < ENUMINFO_STRIPES; i++) {
+		ENUMINFO_LOCK(t, i);
+		if (hash_isempty(t->stripes[i].infos)) {
+			ENUMINFO_UNLOCK(t, i);
 			continue;
 		}
-		if ((enumInfo->timeStamp + aeit > mytime) &&
-				((enumInfo->expires == 0) ||
-				(enumInfo->expires > mytime))) {
-			continue;
-		}
-		if (list == NULL) {
-			list = list_create(LISTCOUNT_T_MAX);
-		}
-		if (list == NULL) {
-			u_unlock(cntx->soap);
-			error("could not create list");
-			return NULL;
+		hash_scan_begin(&hs, t->stripes[i].infos);
+		while ((hn = hash_scan_next(&hs))) {
+			enumInfo = (WsEnumerateInfo *)hnode_get(hn);
+			if (enumInfo->flags & WSMAN_ENUMINFO_INWORK_FLAG) {
+				debug("Enum in work: %s", enumInfo->enumId);
+				continue;
+			}
+			if ((enumInfo->timeStamp + aeit > mytime) &&
+					((enumInfo->expires == 0) ||
+					(enumInfo->expires > mytime))) {
+				continue;
+			}
+			if (list == NULL) {
+				list = list_create(LISTCOUNT_T_MAX);
+			}
+			if (list == NULL) {
+				ENUMINFO_UNLOCK(t, i);
+				error("could not create list");
+				return NULL;
+			}
+			hash_scan_delfree(t->stripes[i].infos, hn);
+			unaccount_enuminfo(t, enumInfo);
+			list_append(list, lnode_create(enumInfo));
+			debug("Enum expired list appended: %s", enumInfo->enumId);
 		}
-		hash_scan_delfree(cntx->enuminfos, hn);
-		list_append(list, lnode_create(enumInfo));
-		debug("Enum expired list appended: %s", enumInfo->enumId);
+		ENUMINFO_UNLOCK(t, i);
 	}
-	u_unlock(cntx->soap);
 	return list;
 }
 
@@ -1384,6 +1792,7 @@ wsman_timeouts_manager(WsContextH cntx, void *opaqueData)
 	WsEnumerateInfo *enumInfo;
 	WsmanStatus status;
 
+	enforce_enum_memory(cntx);
 	if (list == NULL) {
 		return;
 	}
@@ -2500,6 +2909,7 @@ soap_detach_op_doc(SoapOpH op,
 		} else {
 			doc = e->in_doc;
 			e->in_doc = NULL;
+			e->headers = NULL;
 		}
 	}
 	return doc;
@@ -2515,8 +2925,10 @@ soap_set_op_doc(SoapOpH op,
 		op_t           *e = (op_t *) op;
 		if (!inbound)
 			e->out_doc = doc;
-		else
+		else {
 			e->in_doc = doc;
+			e->headers = wsman_get_header_index(doc);
+		}
 		retVal = 0;
 	}
 	return retVal;
@@ -2639,14 +3051,7 @@ soap_destroy(SoapH soap)
 		list_destroy(soap->dispatchList);
 	}
 
-	if (soap->processedMsgIdList) {
-		while (!list_isempty(soap->processedMsgIdList)) {
-			lnode_t *node = list_del_first(soap->processedMsgIdList);
-			u_free(node->list_data);
-			lnode_destroy(node);
-		}
-		list_destroy(soap->processedMsgIdList);
-	}
+	wsman_msgid_set_destroy(soap->processedMsgIds);
 
 
 	if (soap->inboundFilterList) {
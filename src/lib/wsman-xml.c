@@ -376,6 +376,19 @@ void ws_xml_dump_memory_enc(WsXmlDocH doc, char **buf, int *ptrSize,
 	xml_parser_doc_to_memory(doc, buf, ptrSize, encoding);
 }
 
+/**
+ * Dump XML document into a buffer, without an intermediate copy
+ * @param doc XML document
+ * @param buf buffer the document is appended to
+ * @param encoding The encoding to be used
+ * @return 0 on success, non zero on failure
+ */
+int ws_xml_dump_memory_buf(WsXmlDocH doc, u_buf_t *buf,
+			   const char *encoding)
+{
+	return xml_parser_doc_to_buf(doc, buf, encoding);
+}
+
 
 
 /**
@@ -652,6 +665,7 @@ void ws_xml_destroy_doc(WsXmlDocH doc)
 {
 	if (doc) {
 		xml_parser_destroy_doc(doc);
+		u_free(doc->headers);
 		u_free(doc);
 	}
 }
@@ -1484,13 +1498,81 @@ void ws_xml_set_ns(WsXmlNodeH r, const char* namespace, const char* prefix)
 
 int check_envelope_size(WsXmlDocH doc, unsigned int size, const char *charset)
 {
-	char *buf;
-	int len;
+	long len;
 	if(size == 0) return 0; 
-	ws_xml_dump_memory_enc(doc, &buf, &len, charset);
-	ws_xml_free_memory(buf);
+	len = xml_parser_doc_size(doc, charset);
 	if(len > size) return 1;
 	return 0;
 }
 
+/**
+ * Start tracking the serialized size of a document
+ * @param s Size tracker
+ * @param doc XML document
+ * @param charset Encoding the document will be sent in
+ * @return Current size in bytes
+ */
+unsigned long ws_xml_size_init(WsXmlSize *s, WsXmlDocH doc,
+			       const char *charset)
+{
+	long len = xml_parser_doc_size(doc, charset);
+
+	s->doc = doc;
+	s->charset = charset;
+	s->size = len < 0 ? 0 : len;
+	s->nscount = ws_xml_get_ns_count(ws_xml_get_doc_root(doc), 0);
+	return s->size;
+}
+
+/*
+ * Adding or removing the first child changes the markup of its parent
+ * (<a/> vs <a>...</a>), and a new namespace lands on the root element.
+ * Neither shows up in the size of the node itself, so measure again.
+ */
+static int size_needs_measure(WsXmlSize *s, WsXmlNodeH parent)
+{
+	return ws_xml_get_child_count(parent) <= 1 ||
+	       ws_xml_get_ns_count(ws_xml_get_doc_root(s->doc), 0) !=
+	       s->nscount;
+}
+
+/**
+ * Account for a node just added to the tracked document
+ * @param s Size tracker
+ * @param node The new node
+ * @return Current size in bytes
+ */
+unsigned long ws_xml_size_add(WsXmlSize *s, WsXmlNodeH node)
+{
+	long len;
+
+	if (size_needs_measure(s, ws_xml_get_node_parent(node)))
+		return ws_xml_size_init(s, s->doc, s->charset);
+	len = xml_parser_node_size(node, s->charset);
+	if (len > 0)
+		s->size += len;
+	return s->size;
+}
+
+/**
+ * Remove a node from the tracked document and destroy it
+ * @param s Size tracker
+ * @param node The node
+ * @return Current size in bytes
+ */
+unsigned long ws_xml_size_remove(WsXmlSize *s, WsXmlNodeH node)
+{
+	WsXmlNodeH parent = ws_xml_get_node_parent(node);
+	long len = xml_parser_node_size(node, s->charset);
+
+	if (size_needs_measure(s, parent) || len < 0 ||
+	    (unsigned long) len > s->size) {
+		xml_parser_node_remove(node);
+		return ws_xml_size_init(s, s->doc, s->charset);
+	}
+	xml_parser_node_remove(node);
+	s->size -= len;
+	return s->size;
+}
+
 /** @} */
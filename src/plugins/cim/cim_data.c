@@ -44,12 +44,24 @@
 
 #include "wsman-xml-api.h"
 #include "wsman-dispatcher.h"
+#include "wsman-soap.h"
 #include "cim-interface.h"
+#include "sfcc-interface.h"
+#ifdef ENABLE_EVENTING_SUPPORT
+#include "wsman-cimindication-processor.h"
+#endif
 
 #include "cim_data.h"
 
 static char *cim_namespace = NULL;
 hash_t *vendor_namespaces = NULL;
+/* vendor_namespaces sorted by class prefix, see set_vendor_table() */
+static struct vendor_namespace {
+  const char *prefix;
+  size_t len;
+  const char *uri;
+} *vendor_table = NULL;
+static int vendor_table_size = 0;
 char *cim_host = "localhost";
 char *cim_port = DEFAULT_HTTP_CIMOM_PORT;
 char *server_port = "5985";
@@ -57,6 +69,16 @@ char *cim_client_frontend = "XML";
 static int cim_ssl = 1; /* https connection to CIMOM */
 static int cim_verify = 1; /* verify ssl cert */
 static char *cim_trust_store = "/etc/ssl/certs"; /* path to cert trust store */
+static int cim_enum_fanout_threads = 0; /* parallel enumeration of subclasses */
+static int cim_enum_fanout_class_order = 0; /* fan-out results in class order */
+static int cim_connection_pool_size = 0; /* idle clients kept per key */
+static int cim_connection_idle_timeout = 300; /* seconds */
+static int cim_connection_check_interval = 30; /* seconds */
+static int cim_class_cache_size = 0; /* cached class definitions */
+static int cim_class_cache_ttl = 300; /* seconds */
+static int cim_objectpath_cache_size = 0; /* object paths found by enumeration */
+static int cim_objectpath_cache_ttl = 60; /* seconds */
+static char *cim_selector_filter_query = "WQL"; /* NULL = filter locally */
 int omit_schema_optional = 0;
 char *indication_profile_implementation_ns = NULL;
 
@@ -149,9 +171,48 @@ int init( void *self, void **data )
 
 void cleanup( void *self, void *data )
 {
+  cim_release_client_pool();
+#ifdef ENABLE_EVENTING_SUPPORT
+  /* libwsman outlives the plugin, it must not call back into it */
+  cimxml_set_class_change_callback(NULL);
+#endif
+  cim_class_cache_flush();
+  cim_objectpath_cache_flush();
   return;
 }
 
+static int
+vendor_namespace_cmp(const void *a, const void *b)
+{
+  return strcmp(((const struct vendor_namespace *)a)->prefix,
+                ((const struct vendor_namespace *)b)->prefix);
+}
+
+/* build the lookup table of get_vendor_namespace_for_class() */
+static void
+set_vendor_table(hash_t *namespaces)
+{
+  hscan_t hs;
+  hnode_t *hn;
+  int n = 0;
+
+  u_free(vendor_table);
+  vendor_table = NULL;
+  vendor_table_size = 0;
+  if (namespaces == NULL || hash_count(namespaces) == 0)
+    return;
+  vendor_table = u_zalloc(hash_count(namespaces) * sizeof(*vendor_table));
+  hash_scan_begin(&hs, namespaces);
+  while ((hn = hash_scan_next(&hs))) {
+    vendor_table[n].prefix = (const char *) hnode_getkey(hn);
+    vendor_table[n].len = strlen(vendor_table[n].prefix);
+    vendor_table[n].uri = (const char *) hnode_get(hn);
+    n++;
+  }
+  qsort(vendor_table, n, sizeof(*vendor_table), vendor_namespace_cmp);
+  vendor_table_size = n;
+}
+
 void set_config( void *self, dictionary *config )
 {
   debug("reading configuration file options");
@@ -166,6 +227,27 @@ void set_config( void *self, dictionary *config )
     cim_trust_store = iniparser_getstring(config, "cim:trust_store", "/etc/ssl/certs");
     cim_verify = iniparser_getboolean(config, "cim:verify_cert", 0);
     omit_schema_optional = iniparser_getboolean(config, "cim:omit_schema_optional", 0);
+    cim_enum_fanout_threads = iniparser_getint(config, "cim:enum_fanout_threads", 0);
+    cim_enum_fanout_class_order = strcmp(iniparser_getstring(config, "cim:enum_fanout_order", "arrival"), "class") == 0;
+    cim_connection_pool_size = iniparser_getint(config, "cim:connection_pool_size", 0);
+    cim_connection_idle_timeout = iniparser_getint(config, "cim:connection_idle_timeout", 300);
+    cim_connection_check_interval = iniparser_getint(config, "cim:connection_check_interval", 30);
+    cim_class_cache_size = iniparser_getint(config, "cim:class_cache_size", 0);
+    cim_class_cache_ttl = iniparser_getint(config, "cim:class_cache_ttl", 300);
+    cim_objectpath_cache_size = iniparser_getint(config, "cim:objectpath_cache_size", 0);
+    cim_objectpath_cache_ttl = iniparser_getint(config, "cim:objectpath_cache_ttl", 60);
+    cim_selector_filter_query = iniparser_getstring(config, "cim:selector_filter_query", "wql");
+    if (strcasecmp(cim_selector_filter_query, "wql") == 0)
+      cim_selector_filter_query = "WQL";
+    else if (strcasecmp(cim_selector_filter_query, "cql") == 0)
+      cim_selector_filter_query = "CQL";
+    else
+      cim_selector_filter_query = NULL;
+#ifdef ENABLE_EVENTING_SUPPORT
+    if (cim_class_cache_size > 0 &&
+        iniparser_getboolean(config, "cim:class_cache_flush_on_indication", 0))
+      cimxml_set_class_change_callback(cim_class_cache_flush);
+#endif
     indication_profile_implementation_ns = iniparser_getstring(config, "cim:indication_profile_implementation_ns", "root/interop");
     debug("vendor namespaces: %s", namespaces);
     if (namespaces) {
@@ -176,6 +258,7 @@ void set_config( void *self, dictionary *config )
       else
         vendor_namespaces = NULL;
     }
+    set_vendor_table(vendor_namespaces);
     debug("cim namespace: %s", cim_namespace);
   }
   return;
@@ -189,6 +272,40 @@ get_vendor_namespaces()
   return vendor_namespaces;
 }
 
+/*
+ * Resource URI prefix of a class: the vendor namespace named like the
+ * schema part of the class name (Linux_ for Linux_ComputerSystem), else
+ * the first one whose name occurs in it; NULL for none
+ */
+const char *
+get_vendor_namespace_for_class(const char *classname)
+{
+  const char *sep = strchr(classname, '_');
+  size_t len;
+  int lo = 0, hi = vendor_table_size - 1, mid, cmp, i;
+
+  if (sep) {
+    len = sep - classname;
+    while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      cmp = strncmp(vendor_table[mid].prefix, classname, len);
+      if (cmp == 0 && vendor_table[mid].len != len)
+        cmp = vendor_table[mid].len > len ? 1 : -1;
+      if (cmp == 0)
+        return vendor_table[mid].uri;
+      if (cmp < 0)
+        lo = mid + 1;
+      else
+        hi = mid - 1;
+    }
+  }
+  for (i = 0; i < vendor_table_size; i++) {
+    if (strstr(classname, vendor_table[i].prefix))
+      return vendor_table[i].uri;
+  }
+  return NULL;
+}
+
 char *
 get_cim_host()
 {
@@ -253,3 +370,73 @@ get_cim_trust_store()
 {
     return cim_trust_store;
 }
+
+/* connections used to enumerate subclasses in parallel, 0 = off */
+int
+get_cim_enum_fanout_threads()
+{
+    return cim_enum_fanout_threads;
+}
+
+/* return fan-out results in class order instead of arrival order ? */
+int
+get_cim_enum_fanout_class_order()
+{
+    return cim_enum_fanout_class_order;
+}
+
+/* idle CIMOM clients kept for reuse per host, port, frontend and user */
+int
+get_cim_connection_pool_size()
+{
+    return cim_connection_pool_size;
+}
+
+/* seconds a pooled client may stay idle */
+int
+get_cim_connection_idle_timeout()
+{
+    return cim_connection_idle_timeout;
+}
+
+/* seconds a pooled client may stay idle before reuse without a check */
+int
+get_cim_connection_check_interval()
+{
+    return cim_connection_check_interval;
+}
+
+/* class definitions kept across requests, 0 = none */
+int
+get_cim_class_cache_size()
+{
+    return cim_class_cache_size;
+}
+
+/* seconds a cached class definition is used */
+int
+get_cim_class_cache_ttl()
+{
+    return cim_class_cache_ttl;
+}
+
+/* object paths of instances found by enumeration, 0 = none */
+int
+get_cim_objectpath_cache_size()
+{
+    return cim_objectpath_cache_size;
+}
+
+/* seconds a cached object path is used */
+int
+get_cim_objectpath_cache_ttl()
+{
+    return cim_objectpath_cache_ttl;
+}
+
+/* query language selector filters are sent to the CIMOM in, or NULL */
+const char *
+get_cim_selector_filter_query()
+{
+    return cim_selector_filter_query;
+}
@@ -106,6 +106,7 @@ char *get_cim_client_frontend(void);
 char *get_indication_profile_implementation_ns(void);
 
 hash_t* get_vendor_namespaces(void);
+const char *get_vendor_namespace_for_class(const char *classname);
 char *get_cim_host(void);
 char *get_cim_port(void);
 char *get_server_port(void);
@@ -113,4 +114,14 @@ int get_omit_schema_optional(void);
 int get_cim_ssl(void);
 int get_cim_verify(void);
 char *get_cim_trust_store(void);
+int get_cim_enum_fanout_threads(void);
+int get_cim_enum_fanout_class_order(void);
+int get_cim_connection_pool_size(void);
+int get_cim_connection_idle_timeout(void);
+int get_cim_connection_check_interval(void);
+int get_cim_class_cache_size(void);
+int get_cim_class_cache_ttl(void);
+int get_cim_objectpath_cache_size(void);
+int get_cim_objectpath_cache_ttl(void);
+const char *get_cim_selector_filter_query(void);
 #endif // __CIM_DATA_H__
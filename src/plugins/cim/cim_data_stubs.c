@@ -78,11 +78,12 @@ CimResource_destroy(CimClientInfo *cimclient)
 		hash_free(cimclient->selectors);
 		debug("selectors destroyed");
 	}
+	/* the credentials are part of the client's key in the pool */
+	cim_release_client(cimclient);
 	if (cimclient->username)
 		u_free(cimclient->username);
 	if (cimclient->password)
 		u_free(cimclient->password);
-	cim_release_client(cimclient);
 	u_free(cimclient);
 	debug("cimclient destroyed");
 	return;
@@ -110,7 +111,7 @@ CimResource_Init(WsContextH cntx, char *username, char *password)
 
 	debug("Connecting using sfcc %s frontend", get_cim_client_frontend());
 
-	cimclient->cc = (void *)cim_connect_to_cimom(get_cim_host(),
+	cimclient->cc = (void *)cim_get_pooled_client(get_cim_host(),
 			get_cim_port(), username, password , get_cim_client_frontend(), &status);
 
 	if (!cimclient->cc) {
@@ -40,6 +40,10 @@
 #define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <ctype.h>
+#include <pthread.h>
 #include <CimClientLib/cmci.h>
 #include <CimClientLib/native.h>
 #include "u/libu.h"
@@ -61,9 +65,40 @@
 
 extern char *get_server_port(void);
 
+/* upper bound of instances read ahead of the Pull that sends them */
+#define SFCC_ENUM_PREFETCH 32
+/* fan-out gives up on class hierarchies bigger than this */
+#define SFCC_FANOUT_MAX_CLASSES 256
+
 typedef struct _sfcc_enumcontext {
 	CimClientInfo *ecClient;
 	CMPIEnumeration *ecEnumeration;
+	/* fan-out: all enumerations, walked one after the other */
+	CMPIEnumeration **ecMore;
+	int ecNMore;
+	int ecNext;
+	/* streaming mode: ring of instances taken off ecEnumeration
+	 * but not yet sent; NULL if the results were materialized
+	 * into enumInfo->enumResults */
+	CMPIData *ecWindow;
+	int ecHead;
+	int ecCount;
+	int ecEnd;
+	int ecRead;
+	/* window position of the instance at enumInfo->index */
+	int ecAhead;
+	/* MaxElements of the last Pull, the size of a read-ahead */
+	int ecBatch;
+	/* read-ahead: the next ecRenderedCount items, already rendered */
+	WsXmlDocH ecRendered;
+	int ecRenderedCount;
+	/* FragmentTransfer of the Enumerate, for spilling without a request */
+	char *ecFragment;
+	/* rendered size of an item, the unit of enumInfo->memSize */
+	unsigned long ecItemSize;
+	/* spilled: offset of the item at enumInfo->index in the spill file */
+	long ecSpillPos;
+	long ecSpillNext;
 } sfcc_enumcontext;
 
 static int cim_getEprObjAt(CimClientInfo * client, WsEnumerateInfo * enumInfo,
@@ -76,16 +111,56 @@ static int cim_getElementAt(CimClientInfo * client, WsEnumerateInfo * enumInfo,
 		     WsXmlNodeH itemsNode);
 
 
+/* Resource URIs of the classes seen so far, never freed: the classes
+ * come from the CIMOM, their number is bounded by its schema */
+static hash_t *cim_class_uris = NULL;
+static pthread_rwlock_t cim_class_uris_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static char *
+cim_class_resource_uri(const char *class)
+{
+	const char *vendor;
+	char *uri = NULL, *key;
+	hnode_t *hn;
+
+	pthread_rwlock_rdlock(&cim_class_uris_lock);
+	if (cim_class_uris && (hn = hash_lookup(cim_class_uris, class)))
+		uri = (char *) hnode_get(hn);
+	pthread_rwlock_unlock(&cim_class_uris_lock);
+	if (uri)
+		return uri;
+
+	vendor = get_vendor_namespace_for_class(class);
+	uri = u_strdup_printf("%s/%s", vendor ? vendor : XML_NS_CIM_CLASS,
+			class);
+	pthread_rwlock_wrlock(&cim_class_uris_lock);
+	if (cim_class_uris == NULL)
+		cim_class_uris = hash_create(HASHCOUNT_T_MAX, NULL, NULL);
+	if ((hn = hash_lookup(cim_class_uris, class))) {
+		u_free(uri);
+		uri = (char *) hnode_get(hn);
+	} else {
+		/* an allocation failure is fatal here as anywhere else in the
+		 * plugin: once the node exists, hash_insert cannot fail */
+		key = u_strdup(class);
+		hn = hnode_create(uri);
+		hash_insert(cim_class_uris, hn, key);
+	}
+	pthread_rwlock_unlock(&cim_class_uris_lock);
+	return uri;
+}
+
 
+/*
+ * Resource URI of a class, owned by the plugin or the client: callers
+ * must not free it
+ */
 static char *
 cim_find_namespace_for_class(CimClientInfo * client,
 		WsEnumerateInfo * enumInfo,
 		char *classname)
 {
-	char *ns = NULL;
-	char *sub, *target_class = NULL;
-	hscan_t hs;
-	hnode_t *hn;
+	char *target_class = NULL;
 	if (strcmp(client->requested_class, "*")  &&
 			enumInfo && (enumInfo->flags & WSMAN_ENUMINFO_POLY_EXCLUDE)) {
 		if ( (enumInfo->flags & WSMAN_ENUMINFO_EPR ) &&
@@ -103,24 +178,9 @@ cim_find_namespace_for_class(CimClientInfo * client,
 			(strcmp(client->method, TRANSFER_GET) == 0 ||
 			 strcmp(client->method, TRANSFER_DELETE) == 0 ||
 			 strcmp(client->method, TRANSFER_PUT) == 0)) {
-		ns = u_strdup(client->resource_uri);
-		return ns;
-	}
-	if (target_class && client->namespaces) {
-		hash_scan_begin(&hs, client->namespaces);
-		while ((hn = hash_scan_next(&hs))) {
-			//debug("namespace=%s", (char *) hnode_get(hn));
-			if ((sub =  strstr(target_class, (char *) hnode_getkey(hn)))) {
-				ns = u_strdup_printf("%s/%s",(char *) hnode_get(hn), target_class);
-				//debug("vendor namespace match...");
-				break;
-			}
-		}
+		return client->resource_uri;
 	}
-	if (!ns)
-		ns = u_strdup_printf("%s/%s", XML_NS_CIM_CLASS,
-				target_class);
-	return ns;
+	return cim_class_resource_uri(target_class);
 }
 
 
@@ -205,7 +265,6 @@ path2xml(CimClientInfo * client,
 	_path_res_uri = cim_find_namespace_for_class(client, NULL, CMGetCharPtr(classname));
 	ws_xml_add_child_format(refparam, XML_NS_WS_MAN, WSM_RESOURCE_URI,
 			"%s", _path_res_uri);
-	u_free(_path_res_uri);
 
 	wsman_selector_set = ws_xml_add_child(refparam,
 			XML_NS_WS_MAN,
@@ -886,33 +945,297 @@ cleanup:
 
 
 
+/*
+ * Small process-wide caches of CMPI objects: entries expire after the
+ * configured ttl and the least recently used one is evicted once the
+ * configured size is reached.  Callers always get their own clone.
+ */
+typedef struct _sfcc_cached {
+	void *obj;
+	time_t fetched;
+	time_t used;
+} sfcc_cached;
+
+typedef struct _sfcc_cache {
+	hash_t *entries;
+	pthread_mutex_t lock;
+	void *(*clone)(void *obj);
+	void (*release)(void *obj);
+	int (*size)(void);
+	int (*ttl)(void);
+} sfcc_cache;
+
+static void
+sfcc_cache_free_node(hnode_t * hn, void *arg)
+{
+	sfcc_cache *cache = (sfcc_cache *) arg;
+	sfcc_cached *entry = (sfcc_cached *) hnode_get(hn);
+
+	u_free((char *) hnode_getkey(hn));
+	cache->release(entry->obj);
+	u_free(entry);
+	u_free(hn);
+}
+
+static void
+sfcc_cache_flush(sfcc_cache * cache)
+{
+	hscan_t hs;
+	hnode_t *hn;
+
+	pthread_mutex_lock(&cache->lock);
+	if (cache->entries) {
+		hash_scan_begin(&hs, cache->entries);
+		while ((hn = hash_scan_next(&hs)))
+			hash_scan_delfree(cache->entries, hn);
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+static void *
+sfcc_cache_get(sfcc_cache * cache, const char *key)
+{
+	void *obj = NULL;
+	sfcc_cached *entry;
+	time_t now = time(NULL);
+	int ttl = cache->ttl();
+	hnode_t *hn;
+
+	pthread_mutex_lock(&cache->lock);
+	if (cache->entries &&
+			(hn = hash_lookup(cache->entries, key)) != NULL) {
+		entry = (sfcc_cached *) hnode_get(hn);
+		if (ttl > 0 && now - entry->fetched >= ttl) {
+			hash_delete_free(cache->entries, hn);
+		} else {
+			entry->used = now;
+			obj = cache->clone(entry->obj);
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return obj;
+}
+
+static void
+sfcc_cache_put(sfcc_cache * cache, const char *key, void *obj)
+{
+	sfcc_cached *entry;
+	hnode_t *hn, *lru;
+	hscan_t hs;
+	char *copy;
+	time_t now = time(NULL);
+	hashcount_t max = cache->size();
+
+	pthread_mutex_lock(&cache->lock);
+	if (cache->entries == NULL) {
+		cache->entries = hash_create(HASHCOUNT_T_MAX, NULL, NULL);
+		hash_set_allocator(cache->entries, NULL,
+				sfcc_cache_free_node, cache);
+	}
+	if (hash_lookup(cache->entries, key)) {
+		/* someone else was faster */
+		pthread_mutex_unlock(&cache->lock);
+		return;
+	}
+	if (hash_count(cache->entries) >= max) {
+		lru = NULL;
+		hash_scan_begin(&hs, cache->entries);
+		while ((hn = hash_scan_next(&hs))) {
+			if (lru == NULL ||
+					((sfcc_cached *) hnode_get(hn))->used <
+					((sfcc_cached *) hnode_get(lru))->used)
+				lru = hn;
+		}
+		hash_delete_free(cache->entries, lru);
+	}
+	entry = u_zalloc(sizeof(sfcc_cached));
+	entry->obj = cache->clone(obj);
+	entry->fetched = entry->used = now;
+	copy = u_strdup(key);
+	if (entry->obj == NULL ||
+			!hash_alloc_insert(cache->entries, copy, entry)) {
+		if (entry->obj)
+			cache->release(entry->obj);
+		u_free(entry);
+		u_free(copy);
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+static void
+sfcc_cache_forget(sfcc_cache * cache, const char *key)
+{
+	hnode_t *hn;
+
+	pthread_mutex_lock(&cache->lock);
+	if (cache->entries &&
+			(hn = hash_lookup(cache->entries, key)) != NULL)
+		hash_delete_free(cache->entries, hn);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+static void *
+cim_clone_class(void *obj)
+{
+	CMPIConstClass *_class = (CMPIConstClass *) obj;
+	return _class->ft->clone(_class, NULL);
+}
+
+static void
+cim_release_class(void *obj)
+{
+	CMRelease((CMPIConstClass *) obj);
+}
+
+/*
+ * Class definitions shared by all requests, keyed by namespace, class
+ * and getClass flags, see class_cache_size in the [cim] section of
+ * openwsman.conf.
+ */
+static sfcc_cache cim_class_cache = {
+	NULL, PTHREAD_MUTEX_INITIALIZER,
+	cim_clone_class, cim_release_class,
+	get_cim_class_cache_size, get_cim_class_cache_ttl
+};
+
+/* Drop all cached classes, e.g. when a CIM_ClassIndication comes in */
+void
+cim_class_cache_flush(void)
+{
+	sfcc_cache_flush(&cim_class_cache);
+	debug("class cache flushed");
+}
+
+/*
+ * getClass through the class cache, rc is only set when the CIMOM
+ * was asked.  Entries are kept per user and password, like pooled
+ * clients, a class is only served to whom the CIMOM gave it.
+ */
+static CMPIConstClass *
+cim_get_cached_class(CimClientInfo * client, const char *cim_namespace,
+		const char *class, CMPIFlags flags, CMPIStatus * rc)
+{
+	CMCIClient *cc = (CMCIClient *) client->cc;
+	CMPIObjectPath *op;
+	CMPIConstClass *_class;
+	const char *user = client->username ? client->username : "";
+	char *key = NULL;
+
+	if (get_cim_class_cache_size() > 0) {
+		key = u_strdup_printf("%s:%s:%lu:%lu:%s:%s", cim_namespace,
+				class, (unsigned long) flags,
+				(unsigned long) strlen(user), user,
+				client->password ? client->password : "");
+		_class = sfcc_cache_get(&cim_class_cache, key);
+		if (_class) {
+			debug("class %s:%s from cache", cim_namespace, class);
+			u_free(key);
+			return _class;
+		}
+	}
+	op = newCMPIObjectPath(cim_namespace, class, NULL);
+	_class = cc->ft->getClass(cc, op, flags, NULL, rc);
+	if (op)
+		CMRelease(op);
+	if (key && _class)
+		sfcc_cache_put(&cim_class_cache, key, _class);
+	u_free(key);
+	return _class;
+}
+
 static CMPIConstClass *
 cim_get_class(CimClientInfo * client,
 		const char *class,
 		CMPIFlags flags, WsmanStatus * status)
 {
-	CMPIObjectPath *op;
 	CMPIConstClass *_class;
 	CMPIStatus rc;
 
-	CMCIClient *cc = (CMCIClient *) client->cc;
-	op = newCMPIObjectPath(client->cim_namespace, class, NULL);
-	_class = cc->ft->getClass(cc, op, flags, NULL, &rc);
+	memset(&rc, 0, sizeof(CMPIStatus));
+	_class = cim_get_cached_class(client,
+			client->cim_namespace, class, flags, &rc);
 
 	debug("getClass() rc=%d, msg=%s",
 			rc.rc, (rc.msg) ? CMGetCharPtr(rc.msg) : "<NULL>");
 	cim_to_wsman_status(rc, status);
-	if (op)
-		CMRelease(op);
 	return _class;
 }
 
+/*
+ * Compare a property with a selector value, 1 on a match.  Strings and
+ * numbers are compared as they are, only other types are formatted.
+ */
+static int
+cim_selector_matches(CMPIData * data, const char *value)
+{
+	unsigned long long u;
+	long long l;
+	char *end, *valuestr;
+	int match;
+
+	if (data->state & (CMPI_nullValue | CMPI_notFound | CMPI_badValue))
+		return 0;
+	switch (data->type) {
+	case CMPI_string:
+		return data->value.string &&
+			strcmp(CMGetCharPtr(data->value.string), value) == 0;
+	case CMPI_chars:
+		return data->value.chars && strcmp(data->value.chars, value) == 0;
+	case CMPI_boolean:
+		return strcasecmp(value, data->value.boolean ? "true" : "false") == 0;
+	case CMPI_uint8:
+	case CMPI_uint16:
+	case CMPI_uint32:
+	case CMPI_uint64:
+		if (*value == '\0' || *value == '-')
+			return 0;
+		errno = 0;
+		u = strtoull(value, &end, 10);
+		if (*end != '\0' || errno)
+			return 0;
+		switch (data->type) {
+		case CMPI_uint8:
+			return u == data->value.uint8;
+		case CMPI_uint16:
+			return u == data->value.uint16;
+		case CMPI_uint32:
+			return u == data->value.uint32;
+		default:
+			return u == data->value.uint64;
+		}
+	case CMPI_sint8:
+	case CMPI_sint16:
+	case CMPI_sint32:
+	case CMPI_sint64:
+		if (*value == '\0')
+			return 0;
+		errno = 0;
+		l = strtoll(value, &end, 10);
+		if (*end != '\0' || errno)
+			return 0;
+		switch (data->type) {
+		case CMPI_sint8:
+			return l == data->value.sint8;
+		case CMPI_sint16:
+			return l == data->value.sint16;
+		case CMPI_sint32:
+			return l == data->value.sint32;
+		default:
+			return l == data->value.sint64;
+		}
+	default:
+		valuestr = value2Chars(data->type, &data->value);
+		match = valuestr && strcmp(value, valuestr) == 0;
+		u_free(valuestr);
+		return match;
+	}
+}
+
 static int
 filter_instance(CMPIInstance * instance, WsEnumerateInfo * enumInfo)
 {
 	filter_t *filter = enumInfo->filter;
 	int i;
-	int matches = 0;
 	Selector *ss = filter->selectorset.selectors;
 	if (ss == NULL) {
 		debug("epr->refparams.selectors == NULL");
@@ -922,16 +1245,10 @@ filter_instance(CMPIInstance * instance, WsEnumerateInfo * enumInfo)
 		Selector *s;
 		s = ss + i;
 		CMPIData data = instance->ft->getProperty(instance, s->name, NULL);
-		char *valuestr = value2Chars(data.type, &data.value);
-		if (valuestr && strcmp(s->value, valuestr) == 0 ) {
-			matches++;
-		}
-		u_free(valuestr);
+		if (!cim_selector_matches(&data, s->value))
+			return 0;
 	}
-	if (matches == filter->selectorset.count)
-		return 1;
-
-	return 0;
+	return 1;
 }
 
 static void
@@ -956,7 +1273,7 @@ instance2xml(CimClientInfo * client,
 	class_namespace = cim_find_namespace_for_class(client, enumInfo,
 			CMGetCharPtr(classname));
 
-	final_class = u_strdup(strrchr(class_namespace, '/') + 1);
+	final_class = strrchr(class_namespace, '/') + 1;
 
 	if(fragstr) {
 		xmlr = body;
@@ -1017,111 +1334,1013 @@ instance2xml(CimClientInfo * client,
 			CMRelease(_class);
 		}
 	}
-	if(propertystr)
-		u_free(propertystr);
-	if (classname)
-		CMRelease(classname);
-	if (objectpath)
-		CMRelease(objectpath);
-	if (final_class)
-		u_free(final_class);
-	if (class_namespace)
-		u_free(class_namespace);
+	if(propertystr)
+		u_free(propertystr);
+	if (classname)
+		CMRelease(classname);
+	if (objectpath)
+		CMRelease(objectpath);
+}
+
+
+
+static int
+cim_class_abstract(CMPIConstClass * _class)
+{
+	CMPIData data;
+	CMPIStatus rc;
+	int abstract = 0;
+
+	data = _class->ft->getQualifier(_class, "Abstract", &rc);
+	if (rc.rc == 0 && data.type == CMPI_boolean && data.value.boolean)
+		abstract = 1;
+	if (rc.msg)
+		CMRelease(rc.msg);
+	return abstract;
+}
+
+/* 1 if the class carries the Abstract qualifier, -1 if it can't be read */
+static int
+cim_class_is_abstract(CimClientInfo * client, const char *class)
+{
+	CMPIConstClass *_class;
+	int abstract;
+
+	_class = cim_get_class(client, class, CMPI_FLAG_IncludeQualifiers, NULL);
+	if (!_class)
+		return -1;
+	abstract = cim_class_abstract(_class);
+	CMRelease(_class);
+	return abstract;
+}
+
+
+/* 1 if the class is derived from base, walking up its superclasses */
+static int
+cim_class_derives_from(CimClientInfo * client, CMPIConstClass * _class,
+		const char *base)
+{
+	CMPIConstClass *super;
+	const char *name;
+	char *next = NULL;
+	int depth, derived = 0;
+
+	name = _class->ft->getCharSuperClassName(_class);
+	for (depth = 0; name && depth < 64; depth++) {
+		if (strcasecmp(name, base) == 0) {
+			derived = 1;
+			break;
+		}
+		super = cim_get_class(client, name, CMPI_FLAG_IncludeQualifiers,
+				NULL);
+		u_free(next);
+		next = NULL;
+		if (super == NULL)
+			break;
+		name = super->ft->getCharSuperClassName(super);
+		if (name)
+			name = next = u_strdup(name);
+		CMRelease(super);
+	}
+	u_free(next);
+	return derived;
+}
+
+/*
+ * Build the object path straight from the selectors when they name
+ * exactly the keys of a concrete class.  A CreationClassName selector
+ * names that class, which has to be the requested class or one derived
+ * from it, otherwise the requested class is used.  Returns NULL when the
+ * instance has to be looked up by enumeration.
+ */
+static CMPIObjectPath *
+cim_get_op_from_selectors(CimClientInfo * client)
+{
+	char *class = client->requested_class;
+	CMPIConstClass *_class;
+	CMPIObjectPath *objectpath = NULL;
+	selector_entry *sentry;
+	hnode_t *hn;
+	int i, numproperties, nkeys = 0;
+
+	if (client->selectors == NULL || hash_count(client->selectors) == 0)
+		return NULL;
+	if ((hn = hash_lookup(client->selectors, "CreationClassName"))) {
+		sentry = (selector_entry *) hnode_get(hn);
+		if (sentry->type == 0)
+			class = sentry->entry.text;
+	}
+	_class = cim_get_class(client, class, CMPI_FLAG_IncludeQualifiers, NULL);
+	if (_class == NULL)
+		return NULL;
+	if (cim_class_abstract(_class))
+		goto cleanup;
+	if (strcasecmp(class, client->requested_class) != 0 &&
+			!cim_class_derives_from(client, _class,
+				client->requested_class)) {
+		debug("%s is no %s", class, client->requested_class);
+		goto cleanup;
+	}
+
+	numproperties = _class->ft->getPropertyCount(_class, NULL);
+	for (i = 0; i < numproperties; i++) {
+		CMPIString *propertyname;
+		CMPIData data;
+		int found;
+
+		_class->ft->getPropertyAt(_class, i, &propertyname, NULL);
+		data = _class->ft->getPropertyQualifier(_class,
+				CMGetCharPtr(propertyname), "Key", NULL);
+		if (data.state == CMPI_nullValue || !data.value.boolean) {
+			CMRelease(propertyname);
+			continue;
+		}
+		nkeys++;
+		hn = hash_lookup(client->selectors, CMGetCharPtr(propertyname));
+		found = hn && ((selector_entry *) hnode_get(hn))->type == 0;
+		CMRelease(propertyname);
+		if (!found)
+			goto cleanup;
+	}
+	if (nkeys == 0 || nkeys != (int) hash_count(client->selectors))
+		goto cleanup;
+
+	objectpath = newCMPIObjectPath(client->cim_namespace, class, NULL);
+	cim_add_keys(objectpath, client->selectors);
+	debug("object path for %s built from selectors", class);
+cleanup:
+	CMRelease(_class);
+	return objectpath;
+}
+
+
+static void *
+cim_clone_objectpath(void *obj)
+{
+	return CMClone((CMPIObjectPath *) obj, NULL);
+}
+
+static void
+cim_release_objectpath(void *obj)
+{
+	CMRelease((CMPIObjectPath *) obj);
+}
+
+/*
+ * Object paths found by enumeration, keyed by namespace, requested class
+ * and selectors, see objectpath_cache_size in the [cim] section of
+ * openwsman.conf.
+ */
+static sfcc_cache cim_objectpath_cache = {
+	NULL, PTHREAD_MUTEX_INITIALIZER,
+	cim_clone_objectpath, cim_release_objectpath,
+	get_cim_objectpath_cache_size, get_cim_objectpath_cache_ttl
+};
+
+void
+cim_objectpath_cache_flush(void)
+{
+	sfcc_cache_flush(&cim_objectpath_cache);
+}
+
+static int
+cim_cmp_selector_names(const void *a, const void *b)
+{
+	return strcmp(hnode_getkey(*(hnode_t **) a),
+			hnode_getkey(*(hnode_t **) b));
+}
+
+/* Cache key of the request, NULL if there are non-text selectors */
+static char *
+cim_objectpath_cache_key(CimClientInfo * client)
+{
+	hnode_t **nodes;
+	hscan_t hs;
+	hnode_t *hn;
+	char *key, *tmp;
+	int i, n = 0;
+
+	if (get_cim_objectpath_cache_size() <= 0 || client->selectors == NULL)
+		return NULL;
+	nodes = u_malloc(sizeof(hnode_t *) * (hash_count(client->selectors) + 1));
+	hash_scan_begin(&hs, client->selectors);
+	while ((hn = hash_scan_next(&hs))) {
+		if (((selector_entry *) hnode_get(hn))->type != 0) {
+			u_free(nodes);
+			return NULL;
+		}
+		nodes[n++] = hn;
+	}
+	qsort(nodes, n, sizeof(hnode_t *), cim_cmp_selector_names);
+	key = u_strdup_printf("%s:%s", client->cim_namespace,
+			client->requested_class);
+	for (i = 0; i < n; i++) {
+		char *value = ((selector_entry *) hnode_get(nodes[i]))->entry.text;
+		tmp = u_strdup_printf("%s:%s=%lu:%s", key,
+				(char *) hnode_getkey(nodes[i]),
+				(unsigned long) strlen(value), value);
+		u_free(key);
+		key = tmp;
+	}
+	u_free(nodes);
+	return key;
+}
+
+
+/*
+ * An operation (for a concrete instance) is given only the abstract base class
+ * 
+ * Enumerate through all instances of the base class, comparing keys to identify
+ * the matching instance
+ *
+ */
+
+static CMPIObjectPath *
+cim_get_op_from_enum(CimClientInfo * client,
+		WsmanStatus * statusP)
+{
+	CMPIStatus rc;
+	int match = 0;
+	CMPIEnumeration *enumeration;
+	CMPIObjectPath *result_op = NULL;
+	CMPIArray *enumArr = NULL;
+
+	if (client->requested_class)
+		debug("class available");
+
+	CMPIObjectPath *objectpath =
+		newCMPIObjectPath(client->cim_namespace,
+				client->requested_class, NULL);
+	enumeration =
+		((CMCIClient *) client->cc)->ft->enumInstanceNames(client->cc,
+			objectpath,
+			&rc);
+	debug("enumInstanceNames rc=%d, msg=%s", rc.rc,
+			(rc.msg) ? CMGetCharPtr(rc.msg) : NULL);
+
+	if (rc.rc != 0) {
+		cim_to_wsman_status(rc, statusP);
+		//statusP->fault_detail_code = WSMAN_DETAIL_INVALID_RESOURCEURI;
+		if (rc.msg)
+			CMRelease(rc.msg);
+		goto cleanup;
+	}
+
+	enumArr = enumeration->ft->toArray(enumeration, NULL);
+	int n = CMGetArrayCount(enumArr, NULL);
+	if (n > 0) {
+		while (enumeration->ft->hasNext(enumeration, NULL)) {
+			CMPIData data = enumeration->ft->getNext(enumeration,
+					NULL);
+			CMPIObjectPath *op = CMClone(data.value.ref, NULL);
+			CMPIString *opstr = CMObjectPathToString(op, NULL);
+			debug("objectpath: %s", CMGetCharPtr(opstr));
+			if (cim_verify_keys(op, client->selectors, statusP) != 0) {
+				if (opstr)
+					CMRelease(opstr);
+				if (op)
+					CMRelease(op);
+				continue;
+			} else {
+				result_op = CMClone(data.value.ref, NULL);
+				CMSetNameSpace(result_op,
+						client->cim_namespace);
+				match = 1;
+				if (opstr)
+					CMRelease(opstr);
+				if (op)
+					CMRelease(op);
+				break;
+			}
+			if (opstr)
+				CMRelease(opstr);
+			if (op)
+				CMRelease(op);
+		}
+	} else {
+		statusP->fault_code = WSA_DESTINATION_UNREACHABLE;
+		statusP->fault_detail_code =
+			WSMAN_DETAIL_INVALID_RESOURCEURI;
+	}
+	debug("fault: %d %d", statusP->fault_code, statusP->fault_detail_code);
+
+cleanup:
+
+	if (objectpath)
+		CMRelease(objectpath);
+	if (enumeration)
+		CMRelease(enumeration);
+	if (match)
+		return result_op;
+	else
+		return NULL;
+}
+
+
+
+/* Let go of the enumeration(s) the context walks */
+static void
+cim_enum_release_enumerations(sfcc_enumcontext * enumcontext)
+{
+	int i;
+
+	if (enumcontext->ecMore) {
+		for (i = 0; i < enumcontext->ecNMore; i++)
+			CMRelease(enumcontext->ecMore[i]);
+		u_free(enumcontext->ecMore);
+		enumcontext->ecMore = NULL;
+		enumcontext->ecNMore = 0;
+	} else if (enumcontext->ecEnumeration) {
+		CMRelease(enumcontext->ecEnumeration);
+	}
+	enumcontext->ecEnumeration = NULL;
+}
+
+
+/*
+ * Streaming mode: read instances off the enumeration until 'want' of them
+ * (at most SFCC_ENUM_PREFETCH) wait in the window.  totalItems stays one
+ * past the window while the enumeration may have more to give, so the
+ * usual index == totalItems test still marks the end of sequence.
+ */
+static void
+cim_enum_prefetch(WsEnumerateInfo * enumInfo, int want)
+{
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
+	CMPIEnumeration *enumeration = enumcontext->ecEnumeration;
+	CMPIData data;
+
+	if (want <= 0 || want > SFCC_ENUM_PREFETCH)
+		want = SFCC_ENUM_PREFETCH;
+	while (!enumcontext->ecEnd && enumcontext->ecCount < want) {
+		if (!enumeration->ft->hasNext(enumeration, NULL)) {
+			if (enumcontext->ecNext < enumcontext->ecNMore) {
+				/* the window may still point into this one */
+				enumeration = enumcontext->ecMore[enumcontext->ecNext++];
+				enumcontext->ecEnumeration = enumeration;
+				enumcontext->ecRead = 0;
+				continue;
+			}
+			enumcontext->ecEnd = 1;
+			break;
+		}
+		data = enumeration->ft->getNext(enumeration, NULL);
+		enumcontext->ecRead++;
+		if ((enumInfo->flags & WSMAN_ENUMINFO_SELECTOR) &&
+				!filter_instance(data.value.inst, enumInfo))
+			continue;
+		enumcontext->ecWindow[(enumcontext->ecHead + enumcontext->ecCount)
+			% SFCC_ENUM_PREFETCH] = data;
+		enumcontext->ecCount++;
+	}
+	enumInfo->totalItems = enumInfo->index + enumcontext->ecCount +
+		(enumcontext->ecEnd ? 0 : 1);
+}
+
+
+/*
+ * Instance at enumInfo->index, NULL if the enumeration is exhausted
+ */
+static CMPIInstance *
+cim_enum_current(WsEnumerateInfo * enumInfo)
+{
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
+
+	if (enumcontext->ecWindow == NULL) {
+		CMPIArray *results = (CMPIArray *) enumInfo->enumResults;
+		CMPIData data = results->ft->getElementAt(results,
+				enumInfo->index, NULL);
+		return data.value.inst;
+	}
+	if (enumcontext->ecCount <= enumcontext->ecAhead)
+		cim_enum_prefetch(enumInfo, enumcontext->ecAhead + 1);
+	if (enumcontext->ecCount <= enumcontext->ecAhead)
+		return NULL;
+	return enumcontext->ecWindow[(enumcontext->ecHead + enumcontext->ecAhead) %
+		SFCC_ENUM_PREFETCH].value.inst;
+}
+
+
+/*
+ * Step past the instance at enumInfo->index once it made it into the response
+ */
+static void
+cim_enum_advance(WsEnumerateInfo * enumInfo)
+{
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
+
+	enumInfo->index++;
+	if (enumcontext->ecRenderedCount > 0) {
+		ws_xml_unlink_node(ws_xml_get_child(
+			ws_xml_get_doc_root(enumcontext->ecRendered), 0, NULL, NULL));
+		enumcontext->ecRenderedCount--;
+	}
+	if (enumInfo->spillFile) {
+		enumcontext->ecSpillPos = enumcontext->ecSpillNext;
+	} else if (enumcontext->ecWindow && enumcontext->ecCount > 0) {
+		enumcontext->ecHead = (enumcontext->ecHead + 1) % SFCC_ENUM_PREFETCH;
+		enumcontext->ecCount--;
+	}
+}
+
+
+/*
+ * Spilled context: copy the item at enumInfo->index from the spill file,
+ * where cim_spill_enum_context() left it as a document of its own
+ */
+static int
+cim_enum_reload(WsEnumerateInfo * enumInfo, WsXmlNodeH itemsNode)
+{
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
+	FILE *f = enumInfo->spillFile;
+	WsXmlDocH doc;
+	WsXmlNodeH item;
+	unsigned int len;
+	char *buf;
+	int retval = 0;
+
+	if (fseek(f, enumcontext->ecSpillPos, SEEK_SET) ||
+			fread(&len, sizeof(len), 1, f) != 1)
+		return 0;
+	buf = u_malloc(len);
+	if (fread(buf, 1, len, f) == len &&
+			(doc = ws_xml_read_memory(buf, len, "UTF-8", 0)) != NULL) {
+		item = ws_xml_get_child(ws_xml_get_doc_root(doc), 0, NULL, NULL);
+		if (item) {
+			ws_xml_duplicate_tree(itemsNode, item);
+			retval = 1;
+		}
+		ws_xml_destroy_doc(doc);
+	}
+	u_free(buf);
+	enumcontext->ecSpillNext = ftell(f);
+	return retval;
+}
+
+
+static int
+cim_enum_render_item(CimClientInfo * client,
+		WsEnumerateInfo * enumInfo, WsXmlNodeH itemsNode)
+{
+	if (enumInfo->spillFile)
+		return cim_enum_reload(enumInfo, itemsNode);
+	if (enumInfo->flags & WSMAN_ENUMINFO_EPR)
+		return cim_getEprAt(client, enumInfo, itemsNode);
+	if (enumInfo->flags & WSMAN_ENUMINFO_OBJEPR)
+		return cim_getEprObjAt(client, enumInfo, itemsNode);
+	return cim_getElementAt(client, enumInfo, itemsNode);
+}
+
+
+/*
+ * Append the item at enumInfo->index to itemsNode
+ * return 1 on success
+ */
+static int
+cim_enum_render(CimClientInfo * client,
+		WsEnumerateInfo * enumInfo, WsXmlNodeH itemsNode)
+{
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
+
+	if (enumcontext && enumcontext->ecRenderedCount > 0) {
+		ws_xml_duplicate_tree(itemsNode, ws_xml_get_child(
+			ws_xml_get_doc_root(enumcontext->ecRendered), 0, NULL, NULL));
+		return 1;
+	}
+	return cim_enum_render_item(client, enumInfo, itemsNode);
+}
+
+
+/* Forget what was rendered ahead */
+static void
+cim_enum_drop_rendered(sfcc_enumcontext * enumcontext)
+{
+	if (enumcontext->ecRendered)
+		ws_xml_destroy_doc(enumcontext->ecRendered);
+	enumcontext->ecRendered = NULL;
+	enumcontext->ecRenderedCount = 0;
+}
+
+
+/*
+ * Rendered size of the item at enumInfo->index, taken as the size of
+ * every item of the enumeration
+ */
+static unsigned long
+cim_enum_item_size(CimClientInfo * client, WsEnumerateInfo * enumInfo)
+{
+	WsXmlDocH doc = ws_xml_create_doc(XML_NS_ENUMERATION, WSENUM_ITEMS);
+	WsXmlNodeH root = ws_xml_get_doc_root(doc);
+	long size = 0;
+
+	if (cim_enum_render(client, enumInfo, root))
+		size = xml_parser_node_size(ws_xml_get_child(root, 0, NULL, NULL),
+				enumInfo->encoding);
+	ws_xml_destroy_doc(doc);
+	return size > 0 ? size : 0;
+}
+
+
+/*
+ * Tell the library how much the pending items take, see
+ * enum_context_max_memory in openwsman.conf
+ */
+static void
+cim_enum_account(WsEnumerateInfo * enumInfo)
+{
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
+	CMPIEnumeration *enumeration = enumcontext->ecEnumeration;
+	unsigned long pending;
+	CMPIArray *arr;
+	int i;
+
+	if (enumInfo->spillFile) {
+		pending = 0;
+	} else if (enumcontext->ecWindow) {
+		pending = enumcontext->ecCount;
+		if (!enumcontext->ecEnd) {
+			/* sfcc hands out the array behind the enumeration,
+			 * this does not copy */
+			arr = enumeration->ft->toArray(enumeration, NULL);
+			if (arr)
+				pending += arr->ft->getSize(arr, NULL) -
+					enumcontext->ecRead;
+			for (i = enumcontext->ecNext; i < enumcontext->ecNMore; i++) {
+				enumeration = enumcontext->ecMore[i];
+				arr = enumeration->ft->toArray(enumeration, NULL);
+				if (arr)
+					pending += arr->ft->getSize(arr, NULL);
+			}
+		}
+	} else {
+		pending = enumInfo->totalItems - enumInfo->index;
+	}
+	/* rendered ahead, they are held twice */
+	pending += enumcontext->ecRenderedCount;
+	enumInfo->memSize = pending * enumcontext->ecItemSize;
+}
+
+
+/*
+ * WsEndPointSpill: render the pending items into f, each as a length
+ * prefixed document, and let go of the CIM objects holding them.
+ * Called on a context in work, but not from a request of its own.
+ */
+static int
+cim_spill_enum_context(WsEnumerateInfo * enumInfo, FILE * f)
+{
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
+	CimClientInfo *client = enumcontext->ecClient;
+	WsContextH cntx = client->cntx;
+	unsigned int index = enumInfo->index;
+	unsigned int len, count = 0;
+	WsXmlDocH doc;
+	char *buf;
+	int size, c, retval = 0;
+
+	/* whatever request set it is gone, renderers fall back on ecFragment */
+	client->cntx = NULL;
+	while (enumInfo->index < enumInfo->totalItems) {
+		doc = ws_xml_create_doc(XML_NS_ENUMERATION, WSENUM_ITEMS);
+		c = cim_enum_render(client, enumInfo, ws_xml_get_doc_root(doc));
+		if (c) {
+			ws_xml_dump_memory_enc(doc, &buf, &size, "UTF-8");
+			len = size;
+			if (fwrite(&len, sizeof(len), 1, f) != 1 ||
+					fwrite(buf, 1, len, f) != len)
+				retval = 1;
+			ws_xml_free_memory(buf);
+		}
+		ws_xml_destroy_doc(doc);
+		if (!c || retval)
+			break;
+		cim_enum_advance(enumInfo);
+		count++;
+	}
+	client->cntx = cntx;
+	enumInfo->index = index;
+	cim_enum_drop_rendered(enumcontext);
+	if (retval || fflush(f)) {
+		error("spilling enumeration: %s", strerror(errno));
+		if (enumcontext->ecWindow && count > 0) {
+			/* what was read off the enumeration is gone */
+			enumInfo->totalItems = index;
+		}
+		return 1;
+	}
+
+	debug("spilled %u items", count);
+	enumInfo->totalItems = index + count;
+	cim_enum_release_enumerations(enumcontext);
+	if (enumInfo->enumResults && (enumInfo->flags & WSMAN_ENUMINFO_SELECTOR))
+		CMRelease((CMPIArray *) enumInfo->enumResults);
+	enumInfo->enumResults = NULL;
+	u_free(enumcontext->ecWindow);
+	enumcontext->ecWindow = NULL;
+	enumcontext->ecCount = 0;
+	enumcontext->ecSpillPos = 0;
+	return 0;
+}
+
+
+/*
+ * WsEndPointPrefetch: between two Pulls, take the next batch off the
+ * enumeration and, with 'render' set, render it for the next Pull to
+ * copy.  Called on a context in work, but not from a request of its own.
+ */
+static void
+cim_prefetch_enum_context(WsEnumerateInfo * enumInfo, int render)
+{
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
+	CimClientInfo *client = enumcontext->ecClient;
+	WsContextH cntx = client->cntx;
+	unsigned int index = enumInfo->index;
+	int want = enumcontext->ecBatch > 0 ? enumcontext->ecBatch :
+		SFCC_ENUM_PREFETCH;
+	WsXmlNodeH root;
+	int ahead;
+
+	if (enumInfo->spillFile)
+		return;
+	if (enumcontext->ecWindow)
+		cim_enum_prefetch(enumInfo, want + 1);
+	if (render) {
+		if (enumcontext->ecRendered == NULL)
+			enumcontext->ecRendered = ws_xml_create_doc(
+					XML_NS_ENUMERATION, WSENUM_ITEMS);
+		root = ws_xml_get_doc_root(enumcontext->ecRendered);
+		/* whatever request set it is gone, renderers fall back on ecFragment */
+		client->cntx = NULL;
+		for (ahead = enumcontext->ecRenderedCount; ahead < want; ahead++) {
+			if (enumcontext->ecWindow ?
+					ahead >= enumcontext->ecCount :
+					index + ahead >= enumInfo->totalItems)
+				break;
+			enumInfo->index = index + ahead;
+			if (enumcontext->ecWindow)
+				enumcontext->ecAhead = ahead;
+			if (!cim_enum_render_item(client, enumInfo, root))
+				break;
+			enumcontext->ecRenderedCount++;
+		}
+		enumcontext->ecAhead = 0;
+		enumInfo->index = index;
+		client->cntx = cntx;
+	}
+	debug("read ahead: %d items in window, %d rendered",
+			enumcontext->ecCount, enumcontext->ecRenderedCount);
+	cim_enum_account(enumInfo);
+}
+
+
+/* shared state of the workers of one fan-out enumeration */
+typedef struct _sfcc_fanout {
+	CimClientInfo *client;
+	char **classes;
+	int nclasses;
+	int next;		/* next class a worker picks up */
+	int done;
+	int byclass;		/* results in class order, not arrival order */
+	CMPIEnumeration **results;
+	CMCIClient **clients;
+	int nclients;
+	CMPIStatus rc;		/* first failure */
+	pthread_mutex_t lock;
+} sfcc_fanout;
+
+
+/*
+ * Collect the topmost concrete subclasses of an abstract class.  Their
+ * deep enumerations are disjoint and together return every instance of
+ * the abstract class.  One enumClassNames() lists the whole subtree, the
+ * class definitions come from the class cache.
+ */
+static int
+cim_fanout_expand(CimClientInfo * client, char **classes, int *nclasses)
+{
+	CMCIClient *cc = (CMCIClient *) client->cc;
+	CMPIObjectPath *op;
+	CMPIEnumeration *names;
+	CMPIConstClass *_class;
+	CMPIStatus rc;
+	char *subclasses[SFCC_FANOUT_MAX_CLASSES];
+	char *supers[SFCC_FANOUT_MAX_CLASSES];
+	int concrete[SFCC_FANOUT_MAX_CLASSES];
+	const char *super;
+	int i, j, n = 0, ret = 0;
+
+	op = newCMPIObjectPath(client->cim_namespace, client->requested_class,
+			NULL);
+	names = cc->ft->enumClassNames(cc, op, CMPI_FLAG_DeepInheritance, &rc);
+	CMRelease(op);
+	if (rc.msg)
+		CMRelease(rc.msg);
+	if (rc.rc || !names) {
+		if (names)
+			CMRelease(names);
+		return -1;
+	}
+	while (ret == 0 && names->ft->hasNext(names, NULL)) {
+		CMPIData data = names->ft->getNext(names, NULL);
+		CMPIString *name = data.value.ref->ft->getClassName(data.value.ref,
+				NULL);
+
+		if (n == SFCC_FANOUT_MAX_CLASSES) {
+			ret = -1;
+		} else if ((_class = cim_get_class(client, CMGetCharPtr(name),
+					CMPI_FLAG_IncludeQualifiers, NULL))) {
+			super = _class->ft->getCharSuperClassName(_class);
+			subclasses[n] = u_strdup(CMGetCharPtr(name));
+			supers[n] = super ? u_strdup(super) : NULL;
+			concrete[n] = !cim_class_abstract(_class);
+			n++;
+			CMRelease(_class);
+		} else {
+			ret = -1;
+		}
+		CMRelease(name);
+	}
+	CMRelease(names);
+
+	/* concrete classes with no concrete ancestor below the requested one */
+	for (i = 0; ret == 0 && i < n; i++) {
+		if (!concrete[i])
+			continue;
+		super = supers[i];
+		while (super && strcasecmp(super, client->requested_class)) {
+			for (j = 0; j < n; j++) {
+				if (strcasecmp(subclasses[j], super) == 0)
+					break;
+			}
+			if (j == n) {
+				/* not in the subtree listed, don't guess */
+				ret = -1;
+				break;
+			}
+			if (concrete[j])
+				break;
+			super = supers[j];
+		}
+		if (ret == 0 && super &&
+				strcasecmp(super, client->requested_class) == 0)
+			classes[(*nclasses)++] = u_strdup(subclasses[i]);
+	}
+	for (i = 0; i < n; i++) {
+		u_free(subclasses[i]);
+		u_free(supers[i]);
+	}
+	return ret;
+}
+
+
+static int
+cim_fanout_cmp(const void *a, const void *b)
+{
+	return strcasecmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+static void *
+cim_fanout_worker(void *arg)
+{
+	sfcc_fanout *fanout = arg;
+	CimClientInfo *client = fanout->client;
+	CMCIClient *cc;
+	CMPIObjectPath *op;
+	CMPIEnumeration *enumeration;
+	CMPIStatus rc;
+	WsmanStatus status;
+	int i;
+
+	/* a CMCIClient must not be shared between threads */
+	wsman_status_init(&status);
+	cc = cim_get_pooled_client(get_cim_host(), get_cim_port(),
+			client->username, client->password,
+			get_cim_client_frontend(), &status);
+	u_free(status.fault_msg);
+
+	pthread_mutex_lock(&fanout->lock);
+	if (cc)
+		fanout->clients[fanout->nclients++] = cc;
+	else if (fanout->rc.rc == 0)
+		fanout->rc.rc = CMPI_RC_ERR_FAILED;
+	pthread_mutex_unlock(&fanout->lock);
+
+	while (cc) {
+		pthread_mutex_lock(&fanout->lock);
+		if (fanout->rc.rc || fanout->next == fanout->nclasses) {
+			pthread_mutex_unlock(&fanout->lock);
+			break;
+		}
+		i = fanout->next++;
+		pthread_mutex_unlock(&fanout->lock);
+
+		op = newCMPIObjectPath(client->cim_namespace,
+				fanout->classes[i], NULL);
+		enumeration = cc->ft->enumInstances(cc, op,
+				CMPI_FLAG_DeepInheritance, NULL, &rc);
+		CMRelease(op);
+		debug("fan-out enumInstances(%s) rc=%d", fanout->classes[i],
+				rc.rc);
+
+		pthread_mutex_lock(&fanout->lock);
+		if (rc.rc) {
+			if (enumeration)
+				CMRelease(enumeration);
+			if (fanout->rc.rc == 0)
+				fanout->rc = rc;
+			else if (rc.msg)
+				CMRelease(rc.msg);
+		} else {
+			if (rc.msg)
+				CMRelease(rc.msg);
+			fanout->results[fanout->byclass ? i : fanout->done] =
+				enumeration;
+			fanout->done++;
+		}
+		pthread_mutex_unlock(&fanout->lock);
+	}
+	return NULL;
+}
+
+
+/*
+ * Split the enumeration of an abstract class into one enumeration per
+ * concrete subclass tree and run those on enum_fanout_threads parallel
+ * CIMOM connections.  Returns 0 if the request is not worth fanning
+ * out, the caller then enumerates the class itself.  Otherwise *rc
+ * tells how it went and, on success, *enumerations holds the results.
+ */
+static int
+cim_fanout_enum_instances(CimClientInfo * client,
+		CMPIEnumeration *** enumerations,
+		int *nenumerations, CMPIStatus * rc)
+{
+	sfcc_fanout fanout;
+	pthread_t *threads;
+	int nthreads = get_cim_enum_fanout_threads();
+	int started, i, n;
+
+	/* without the class cache, finding the subclasses costs a getClass
+	 * per class and request */
+	if (nthreads <= 0 || get_cim_class_cache_size() <= 0 ||
+			strcmp(client->requested_class, "*") == 0)
+		return 0;
+	if (cim_class_is_abstract(client, client->requested_class) != 1)
+		return 0;
+
+	memset(&fanout, 0, sizeof(sfcc_fanout));
+	fanout.classes = u_zalloc(SFCC_FANOUT_MAX_CLASSES * sizeof(char *));
+	if (cim_fanout_expand(client, fanout.classes, &fanout.nclasses) ||
+			fanout.nclasses < 2) {
+		debug("not fanning out %s: %d classes", client->requested_class,
+				fanout.nclasses);
+		for (i = 0; i < fanout.nclasses; i++)
+			u_free(fanout.classes[i]);
+		u_free(fanout.classes);
+		return 0;
+	}
+	fanout.client = client;
+	fanout.byclass = get_cim_enum_fanout_class_order();
+	if (fanout.byclass)
+		qsort(fanout.classes, fanout.nclasses, sizeof(char *),
+				cim_fanout_cmp);
+	if (nthreads > fanout.nclasses)
+		nthreads = fanout.nclasses;
+	fanout.results = u_zalloc(fanout.nclasses * sizeof(CMPIEnumeration *));
+	fanout.clients = u_zalloc(nthreads * sizeof(CMCIClient *));
+	pthread_mutex_init(&fanout.lock, NULL);
+
+	debug("fanning out %s over %d classes, %d threads",
+			client->requested_class, fanout.nclasses, nthreads);
+	threads = u_zalloc(nthreads * sizeof(pthread_t));
+	for (started = 0; started < nthreads; started++) {
+		if (pthread_create(&threads[started], NULL, cim_fanout_worker,
+					&fanout))
+			break;
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	u_free(threads);
+	pthread_mutex_destroy(&fanout.lock);
+
+	/* the enumerations don't need the connections they came from */
+	for (i = 0; i < fanout.nclients; i++)
+		cim_put_pooled_client(fanout.clients[i], get_cim_host(),
+				get_cim_port(), client->username,
+				client->password, get_cim_client_frontend());
+	u_free(fanout.clients);
+	for (i = 0; i < fanout.nclasses; i++)
+		u_free(fanout.classes[i]);
+	u_free(fanout.classes);
+
+	for (i = n = 0; i < fanout.nclasses; i++) {
+		if (fanout.results[i])
+			fanout.results[n++] = fanout.results[i];
+	}
+	if (started == 0 || fanout.rc.rc || n == 0) {
+		for (i = 0; i < n; i++)
+			CMRelease(fanout.results[i]);
+		u_free(fanout.results);
+		if (started == 0 || (fanout.rc.rc == 0 && n == 0))
+			return 0;
+		*rc = fanout.rc;
+		return 1;
+	}
+	*enumerations = fanout.results;
+	*nenumerations = n;
+	memset(rc, 0, sizeof(CMPIStatus));
+	return 1;
+}
+
+
+/* Names from the client only go into a query if they are identifiers */
+static int
+cim_is_identifier(const char *name)
+{
+	if (name == NULL || !(isalpha((unsigned char) *name) || *name == '_'))
+		return 0;
+	while (*++name)
+		if (!(isalnum((unsigned char) *name) || *name == '_'))
+			return 0;
+	return 1;
+}
+
+/*
+ * The selector filter as a query on the requested class, NULL if it can't
+ * be written as one.  Built from the selector values alone, without the
+ * class: only values that can't be anything but strings go in, numbers
+ * and booleans may be strings too and are left to filter_instance().
+ */
+static char *
+cim_selector_filter_query(CimClientInfo * client, filter_t * filter)
+{
+	Selector *s;
+	char *query, *tmp, *end;
+	int i;
+
+	if (filter->selectorset.count <= 0 ||
+			!cim_is_identifier(client->requested_class))
+		return NULL;
+	query = u_strdup_printf("SELECT * FROM %s WHERE ",
+			client->requested_class);
+	for (i = 0; i < filter->selectorset.count && query; i++) {
+		s = filter->selectorset.selectors + i;
+		if (s->type == 0 && *s->value != '\0' &&
+				cim_is_identifier(s->name)) {
+			strtod(s->value, &end);
+			if (*end == '\0' || strcasecmp(s->value, "true") == 0 ||
+					strcasecmp(s->value, "false") == 0 ||
+					strpbrk(s->value, "'\\") != NULL)
+				s = NULL;
+		} else {
+			s = NULL;
+		}
+		if (s == NULL) {
+			debug("selector %s can't go into a query",
+					filter->selectorset.selectors[i].name);
+			u_free(query);
+			query = NULL;
+			break;
+		}
+		tmp = u_strdup_printf("%s%s%s = '%s'", query, i ? " AND " : "",
+				s->name, s->value);
+		u_free(query);
+		query = tmp;
+	}
+	return query;
 }
 
-
-
 /*
- * An operation (for a concrete instance) is given only the abstract base class
- * 
- * Enumerate through all instances of the base class, comparing keys to identify
- * the matching instance
- *
+ * Let the CIMOM do the selector filtering, NULL if it won't.  The items
+ * still go through filter_instance(), the query only narrows them down.
  */
-
-static CMPIObjectPath *
-cim_get_op_from_enum(CimClientInfo * client,
-		WsmanStatus * statusP)
+static CMPIEnumeration *
+cim_enum_selector_query(CimClientInfo * client,
+		CMPIObjectPath * objectpath, filter_t * filter)
 {
-	CMPIStatus rc;
-	int match = 0;
+	CMCIClient *cc = (CMCIClient *) client->cc;
 	CMPIEnumeration *enumeration;
-	CMPIObjectPath *result_op = NULL;
-	CMPIArray *enumArr = NULL;
-
-	if (client->requested_class)
-		debug("class available");
+	const char *lang = get_cim_selector_filter_query();
+	CMPIStatus rc;
+	char *query;
 
-	CMPIObjectPath *objectpath =
-		newCMPIObjectPath(client->cim_namespace,
-				client->requested_class, NULL);
-	enumeration =
-		((CMCIClient *) client->cc)->ft->enumInstanceNames(client->cc,
-			objectpath,
-			&rc);
-	debug("enumInstanceNames rc=%d, msg=%s", rc.rc,
+	if (lang == NULL || (query = cim_selector_filter_query(client, filter)) == NULL)
+		return NULL;
+	enumeration = cc->ft->execQuery(cc, objectpath, query, (char *) lang, &rc);
+	debug("execQuery(%s, %s) rc=%d, msg=%s", lang, query, rc.rc,
 			(rc.msg) ? CMGetCharPtr(rc.msg) : NULL);
-
-	if (rc.rc != 0) {
-		cim_to_wsman_status(rc, statusP);
-		//statusP->fault_detail_code = WSMAN_DETAIL_INVALID_RESOURCEURI;
-		if (rc.msg)
-			CMRelease(rc.msg);
-		goto cleanup;
-	}
-
-	enumArr = enumeration->ft->toArray(enumeration, NULL);
-	int n = CMGetArrayCount(enumArr, NULL);
-	if (n > 0) {
-		while (enumeration->ft->hasNext(enumeration, NULL)) {
-			CMPIData data = enumeration->ft->getNext(enumeration,
-					NULL);
-			CMPIObjectPath *op = CMClone(data.value.ref, NULL);
-			CMPIString *opstr = CMObjectPathToString(op, NULL);
-			debug("objectpath: %s", CMGetCharPtr(opstr));
-			if (cim_verify_keys(op, client->selectors, statusP) != 0) {
-				if (opstr)
-					CMRelease(opstr);
-				if (op)
-					CMRelease(op);
-				continue;
-			} else {
-				result_op = CMClone(data.value.ref, NULL);
-				CMSetNameSpace(result_op,
-						client->cim_namespace);
-				match = 1;
-				if (opstr)
-					CMRelease(opstr);
-				if (op)
-					CMRelease(op);
-				break;
-			}
-			if (opstr)
-				CMRelease(opstr);
-			if (op)
-				CMRelease(op);
-		}
-	} else {
-		statusP->fault_code = WSA_DESTINATION_UNREACHABLE;
-		statusP->fault_detail_code =
-			WSMAN_DETAIL_INVALID_RESOURCEURI;
-	}
-	debug("fault: %d %d", statusP->fault_code, statusP->fault_detail_code);
-
-cleanup:
-
-	if (objectpath)
-		CMRelease(objectpath);
-	if (enumeration)
+	if (rc.msg)
+		CMRelease(rc.msg);
+	if (rc.rc != 0 && enumeration) {
 		CMRelease(enumeration);
-	if (match)
-		return result_op;
-	else
-		return NULL;
+		enumeration = NULL;
+	}
+	u_free(query);
+	return enumeration;
 }
 
 
-
 void
 cim_enum_instances(CimClientInfo * client,
 		WsEnumerateInfo * enumInfo,
@@ -1129,10 +2348,13 @@ cim_enum_instances(CimClientInfo * client,
 {
 	CMPIObjectPath *objectpath = NULL;
 	CMPIEnumeration *enumeration = NULL;
+	CMPIEnumeration **enumerations = NULL;
+	int nenumerations = 0;
 	CMPIStatus rc;
 	CMCIClient *cc = (CMCIClient *) client->cc;
 	sfcc_enumcontext *enumcontext;
 	filter_t *filter = NULL;
+	char *fragstr;
 	filter = enumInfo->filter;
 
 	if( (enumInfo->flags & WSMAN_ENUMINFO_REF) ||
@@ -1186,10 +2408,19 @@ cim_enum_instances(CimClientInfo * client,
                 status->fault_code = WSEN_CANNOT_PROCESS_FILTER;
                 status->fault_detail_code = WSMAN_DETAIL_NOT_SUPPORTED;
                 goto cleanup;
-	} else {
+	} else if ((enumInfo->flags & WSMAN_ENUMINFO_SELECTOR) &&
+			(enumeration = cim_enum_selector_query(client,
+					objectpath, filter)) != NULL) {
+		memset(&rc, 0, sizeof(CMPIStatus));
+	} else if ((enumInfo->flags & (WSMAN_ENUMINFO_EST_COUNT |
+					WSMAN_ENUMINFO_POLY_NONE)) ||
+			!cim_fanout_enum_instances(client, &enumerations,
+				&nenumerations, &rc)) {
 		enumeration = cc->ft->enumInstances(cc, objectpath,
 				CMPI_FLAG_DeepInheritance,
 				NULL, &rc);
+	} else if (rc.rc == 0) {
+		enumeration = enumerations[0];
 	}
 
 	debug("enumInstances() rc=%d, msg=%s",
@@ -1204,8 +2435,41 @@ cim_enum_instances(CimClientInfo * client,
 			CMRelease(objectpath);
 		goto cleanup;
 	}
+	cim_to_wsman_status(rc, status);
+	if (rc.msg)
+		CMRelease(rc.msg);
+
+	enumcontext = u_zalloc(sizeof(sfcc_enumcontext));
+	enumcontext->ecClient = client;
+	enumcontext->ecEnumeration = enumeration;
+	if (enumerations) {
+		enumcontext->ecMore = enumerations;
+		enumcontext->ecNMore = nenumerations;
+		enumcontext->ecNext = 1;
+	}
+	fragstr = wsman_get_fragment_string(client->cntx, client->cntx->indoc);
+	enumcontext->ecFragment = fragstr ? u_strdup(fragstr) : NULL;
+	enumInfo->appEnumContext = enumcontext;
+	enumInfo->spillproc = cim_spill_enum_context;
+	enumInfo->prefetchproc = cim_prefetch_enum_context;
+
+	if (!(enumInfo->flags & WSMAN_ENUMINFO_EST_COUNT)) {
+		/* nobody asked for TotalItemsCountEstimate: walk the
+		 * enumeration lazily instead of copying it into an array */
+		enumcontext->ecWindow = u_zalloc(SFCC_ENUM_PREFETCH *
+				sizeof(CMPIData));
+		enumInfo->flags |= WSMAN_ENUMINFO_TOTAL_UNKNOWN;
+		cim_enum_prefetch(enumInfo, 1);
+		debug("Streaming enumeration, %s",
+				enumInfo->totalItems ? "items pending" : "empty");
+		goto done;
+	}
+
 	CMPIArray *enumArr = enumeration->ft->toArray(enumeration, NULL);
 	CMPIArray *fenumArr = NULL;
+	if (!enumArr) {
+		goto done;
+	}
 	if (enumInfo->flags & WSMAN_ENUMINFO_SELECTOR) {
 		CMPIType t = enumArr->ft->getSimpleType(enumArr, NULL);
 		fenumArr = newCMPIArray(0, t , NULL);
@@ -1222,21 +2486,13 @@ cim_enum_instances(CimClientInfo * client,
 		fenumArr = enumArr;
 	}
 
-	cim_to_wsman_status(rc, status);
-	if (rc.msg)
-		CMRelease(rc.msg);
-	if (!enumArr) {
-		goto cleanup;
-	}
-
 	enumInfo->totalItems = cim_enum_totalItems(fenumArr);
 	debug("Total items: %d", enumInfo->totalItems);
-	enumcontext = u_zalloc(sizeof(sfcc_enumcontext));
-	enumcontext->ecClient = client;
-	enumcontext->ecEnumeration = enumeration;
 	enumInfo->enumResults = fenumArr;
-	enumInfo->appEnumContext = enumcontext;
-
+done:
+	if (enumInfo->totalItems > 0)
+		enumcontext->ecItemSize = cim_enum_item_size(client, enumInfo);
+	cim_enum_account(enumInfo);
 	if (objectpath)
 		CMRelease(objectpath);
 cleanup:
@@ -1255,12 +2511,12 @@ cim_getElementAt(CimClientInfo * client,
 {
 	int retval = 1;
 	char *fragstr = NULL;
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
 
-	CMPIArray *results = (CMPIArray *) enumInfo->enumResults;
-	CMPIData data = results->ft->getElementAt(results,
-			enumInfo->index, NULL);
+	CMPIInstance *instance = cim_enum_current(enumInfo);
+	if (instance == NULL)
+		return 0;
 
-	CMPIInstance *instance = data.value.inst;
 	CMPIObjectPath *objectpath = instance->ft->getObjectPath(instance, NULL);
 	CMPIString *classname = objectpath->ft->getClassName(objectpath, NULL);
 
@@ -1269,7 +2525,10 @@ cim_getElementAt(CimClientInfo * client,
 		retval = 0;
 	}
 
-	fragstr = wsman_get_fragment_string(client->cntx, client->cntx->indoc);
+	if (client->cntx)
+		fragstr = wsman_get_fragment_string(client->cntx, client->cntx->indoc);
+	else
+		fragstr = enumcontext->ecFragment;
 	if(fragstr) {
 		itemsNode = ws_xml_add_child(itemsNode, XML_NS_WS_MAN, WSM_XML_FRAGMENT,
 				NULL);
@@ -1296,11 +2555,10 @@ cim_getEprAt(CimClientInfo * client,
 {
 	int retval = 1;
 	char *uri = NULL;
-	CMPIArray *results = (CMPIArray *) enumInfo->enumResults;
-	CMPIData data = results->ft->getElementAt(results,
-			enumInfo->index, NULL);
+	CMPIInstance *instance = cim_enum_current(enumInfo);
+	if (instance == NULL)
+		return 0;
 
-	CMPIInstance *instance = data.value.inst;
 	CMPIObjectPath *objectpath = instance->ft->getObjectPath(instance, NULL);
 	CMPIString *classname = objectpath->ft->getClassName(objectpath, NULL);
 
@@ -1313,7 +2571,6 @@ cim_getEprAt(CimClientInfo * client,
 		cim_add_epr(client, itemsNode, uri, objectpath);
 	}
 
-	u_free(uri);
 	if (classname)
 		CMRelease(classname);
 	if (objectpath)
@@ -1334,11 +2591,10 @@ cim_getEprObjAt(CimClientInfo * client,
 {
 	int retval = 1;
 	char *uri = NULL;
-	CMPIArray *results = (CMPIArray *) enumInfo->enumResults;
-	CMPIData data =
-		results->ft->getElementAt(results, enumInfo->index, NULL);
+	CMPIInstance *instance = cim_enum_current(enumInfo);
+	if (instance == NULL)
+		return 0;
 
-	CMPIInstance *instance = data.value.inst;
 	CMPIObjectPath *objectpath =
 		instance->ft->getObjectPath(instance, NULL);
 	CMPIString *classname =
@@ -1357,7 +2613,6 @@ cim_getEprObjAt(CimClientInfo * client,
 		instance2xml(client, instance, NULL, item, enumInfo);
 		cim_add_epr(client, item, uri, objectpath);
 	}
-	u_free(uri);
 	if (classname)
 		CMRelease(classname);
 	if (objectpath)
@@ -1641,11 +2896,220 @@ cim_connect_to_cimom(char *cim_host,
 	return cimclient;
 }
 
+/*
+ * Idle CIMOM clients, kept for the next request with the same host,
+ * port, frontend and credentials, see connection_pool_size in the [cim]
+ * section of openwsman.conf.  Most recently returned first.
+ */
+typedef struct _sfcc_pooled_client {
+	struct _sfcc_pooled_client *next;
+	CMCIClient *cc;
+	char *host;
+	char *port;
+	char *frontend;
+	char *userid;
+	char *passwd;
+	time_t idleSince;
+} sfcc_pooled_client;
+
+static sfcc_pooled_client *cim_client_pool = NULL;
+static pthread_mutex_t cim_client_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+cim_pool_streq(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
+/* the password is part of the key, the CIMOM did the authentication */
+static int
+cim_pool_match(sfcc_pooled_client * p, char *cim_host, char *cim_port,
+		char *userid, char *passwd, char *frontend)
+{
+	return cim_pool_streq(p->host, cim_host) &&
+		cim_pool_streq(p->port, cim_port) &&
+		cim_pool_streq(p->frontend, frontend) &&
+		cim_pool_streq(p->userid, userid) &&
+		cim_pool_streq(p->passwd, passwd);
+}
+
+static void
+cim_pool_free(sfcc_pooled_client * p)
+{
+	sfcc_pooled_client *next;
+
+	for (; p; p = next) {
+		next = p->next;
+		if (p->cc)
+			CMRelease(p->cc);
+		u_free(p->host);
+		u_free(p->port);
+		u_free(p->frontend);
+		u_free(p->userid);
+		u_free(p->passwd);
+		u_free(p);
+	}
+}
+
+/* Unlink the clients idle for connection_idle_timeout, under the lock */
+static sfcc_pooled_client *
+cim_pool_expire(time_t now)
+{
+	sfcc_pooled_client **pp = &cim_client_pool;
+	sfcc_pooled_client *p, *expired = NULL;
+	int timeout = get_cim_connection_idle_timeout();
+
+	while ((p = *pp) != NULL) {
+		if (timeout > 0 && now - p->idleSince >= timeout) {
+			*pp = p->next;
+			p->next = expired;
+			expired = p;
+		} else {
+			pp = &p->next;
+		}
+	}
+	return expired;
+}
+
+/*
+ * Health check of a client that sat idle for a while: one cheap request,
+ * any answer of the CIMOM short of a failure will do
+ */
+static int
+cim_pool_check(CMCIClient * cc)
+{
+	CMPIObjectPath *op;
+	CMPIConstClass *_class;
+	CMPIStatus rc;
+
+	memset(&rc, 0, sizeof(CMPIStatus));
+	op = newCMPIObjectPath(get_cim_namespace(), "CIM_ManagedElement", NULL);
+	_class = cc->ft->getClass(cc, op, CMPI_FLAG_LocalOnly, NULL, &rc);
+	debug("pooled client check rc=%d", rc.rc);
+	if (_class)
+		CMRelease(_class);
+	if (rc.msg)
+		CMRelease(rc.msg);
+	CMRelease(op);
+	return rc.rc != CMPI_RC_ERR_FAILED && rc.rc != CMPI_RC_ERR_ACCESS_DENIED;
+}
+
+/*
+ * Take a live client off the pool, or connect a new one
+ */
+CMCIClient *
+cim_get_pooled_client(char *cim_host,
+		char *cim_port,
+		char *cim_host_userid,
+		char *cim_host_passwd,
+		char *frontend,
+		WsmanStatus * status)
+{
+	sfcc_pooled_client **pp, *p, *found, *expired;
+	time_t now;
+	CMCIClient *cc;
+
+	while (get_cim_connection_pool_size() > 0) {
+		now = time(NULL);
+		found = NULL;
+		pthread_mutex_lock(&cim_client_pool_lock);
+		expired = cim_pool_expire(now);
+		for (pp = &cim_client_pool; (p = *pp) != NULL; pp = &p->next) {
+			if (cim_pool_match(p, cim_host, cim_port,
+					cim_host_userid, cim_host_passwd, frontend)) {
+				*pp = p->next;
+				p->next = NULL;
+				found = p;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&cim_client_pool_lock);
+		cim_pool_free(expired);
+		if (found == NULL)
+			break;
+
+		if (now - found->idleSince < get_cim_connection_check_interval() ||
+				cim_pool_check(found->cc)) {
+			debug("reusing cimclient: 0x%8x", found->cc);
+			cc = found->cc;
+			found->cc = NULL;
+			cim_pool_free(found);
+			return cc;
+		}
+		debug("pooled cimclient 0x%8x failed the check", found->cc);
+		cim_pool_free(found);
+	}
+	return cim_connect_to_cimom(cim_host, cim_port, cim_host_userid,
+			cim_host_passwd, frontend, status);
+}
+
+/*
+ * Give a client back for reuse, unless connection_pool_size clients
+ * with the same key are idle already
+ */
+void
+cim_put_pooled_client(CMCIClient * cc,
+		char *cim_host,
+		char *cim_port,
+		char *cim_host_userid,
+		char *cim_host_passwd,
+		char *frontend)
+{
+	sfcc_pooled_client *p, *expired;
+	int max = get_cim_connection_pool_size();
+	int count = 0;
+	time_t now = time(NULL);
+
+	pthread_mutex_lock(&cim_client_pool_lock);
+	expired = cim_pool_expire(now);
+	for (p = cim_client_pool; p; p = p->next) {
+		if (cim_pool_match(p, cim_host, cim_port,
+				cim_host_userid, cim_host_passwd, frontend))
+			count++;
+	}
+	if (count < max) {
+		p = u_zalloc(sizeof(sfcc_pooled_client));
+		p->cc = cc;
+		p->host = u_strdup(cim_host);
+		p->port = u_strdup(cim_port);
+		p->frontend = u_strdup(frontend);
+		p->userid = cim_host_userid ? u_strdup(cim_host_userid) : NULL;
+		p->passwd = cim_host_passwd ? u_strdup(cim_host_passwd) : NULL;
+		p->idleSince = now;
+		p->next = cim_client_pool;
+		cim_client_pool = p;
+		cc = NULL;
+	}
+	pthread_mutex_unlock(&cim_client_pool_lock);
+	cim_pool_free(expired);
+	if (cc)
+		CMRelease(cc);
+}
+
+/* Let go of all idle clients, when the plugin is unloaded */
+void
+cim_release_client_pool(void)
+{
+	sfcc_pooled_client *p;
+
+	pthread_mutex_lock(&cim_client_pool_lock);
+	p = cim_client_pool;
+	cim_client_pool = NULL;
+	pthread_mutex_unlock(&cim_client_pool_lock);
+	cim_pool_free(p);
+}
+
 void
 cim_release_client(CimClientInfo * cimclient)
 {
 	if (cimclient->cc) {
-		CMRelease((CMCIClient *) cimclient->cc);
+		cim_put_pooled_client((CMCIClient *) cimclient->cc,
+				get_cim_host(), get_cim_port(),
+				cimclient->username, cimclient->password,
+				get_cim_client_frontend());
+		cimclient->cc = NULL;
 	}
 }
 
@@ -1723,10 +3187,13 @@ void
 invoke_get_class(CimClientInfo *client, WsXmlNodeH body, CMPIStatus *rc)
 {
 	CMPIObjectPath *op = newCMPIObjectPath(client->cim_namespace, client->requested_class, NULL);
-	CMCIClient *cc = (CMCIClient *)client->cc;
-	CMPIConstClass *_class = cc->ft->getClass(cc, op,
+	CMPIConstClass *_class;
+
+	memset(rc, 0, sizeof(CMPIStatus));
+	_class = cim_get_cached_class(client, client->cim_namespace,
+		client->requested_class,
 		client->flags | (CMPI_FLAG_LocalOnly|CMPI_FLAG_IncludeQualifiers|CMPI_FLAG_IncludeClassOrigin),
-		NULL, rc);
+		rc);
 
         debug("invoke_get_class");
   
@@ -1873,34 +3340,99 @@ cleanup:
 
 
 
+/*
+ * Ways to find the instance a Get or Delete on a generic class URI is
+ * about, cheapest first.  Only enumeration is authoritative, the other
+ * ones are tried and dropped if the CIMOM rejects the path.
+ */
+enum {
+	SFCC_OP_FROM_SELECTORS,
+	SFCC_OP_FROM_CACHE,
+	SFCC_OP_FROM_ENUM,
+	SFCC_OP_LOOKUPS
+};
+
+static CMPIObjectPath *
+cim_lookup_op(CimClientInfo * client, int lookup, const char *key,
+		WsmanStatus * status)
+{
+	CMPIObjectPath *objectpath = NULL;
+
+	switch (lookup) {
+	case SFCC_OP_FROM_SELECTORS:
+		objectpath = cim_get_op_from_selectors(client);
+		break;
+	case SFCC_OP_FROM_CACHE:
+		if (key)
+			objectpath = sfcc_cache_get(&cim_objectpath_cache, key);
+		break;
+	default:
+		objectpath = cim_get_op_from_enum(client, status);
+		if (objectpath && key)
+			sfcc_cache_put(&cim_objectpath_cache, key, objectpath);
+		break;
+	}
+	return objectpath;
+}
+
+/* A guessed object path failed, try the next lookup */
+static int
+cim_retry_lookup(int lookup, const char *key, CMPIStatus * rc)
+{
+	if (rc->rc == 0 || lookup == SFCC_OP_FROM_ENUM)
+		return 0;
+	debug("lookup %d failed, rc=%d, msg=%s", lookup, rc->rc,
+			(rc->msg) ? CMGetCharPtr(rc->msg) : NULL);
+	if (rc->msg)
+		CMRelease(rc->msg);
+	if (lookup == SFCC_OP_FROM_CACHE)
+		sfcc_cache_forget(&cim_objectpath_cache, key);
+	return 1;
+}
+
+
 void
 cim_delete_instance_from_enum(CimClientInfo * client, WsmanStatus * status)
 {
 	CMPIObjectPath *objectpath = NULL;
 	CMPIStatus rc;
 	CMCIClient *cc = (CMCIClient *) client->cc;
+	char *key;
+	int lookup;
 
 	if (!cc) {
-		goto cleanup;
+		return;
 	}
 
-	if ((objectpath = cim_get_op_from_enum(client, status)) != NULL) {
-        u_free(status->fault_msg);
-        wsman_status_init(status);
+	key = cim_objectpath_cache_key(client);
+	for (lookup = 0; lookup < SFCC_OP_LOOKUPS; lookup++) {
+		objectpath = cim_lookup_op(client, lookup, key, status);
+		if (objectpath == NULL)
+			continue;
+		u_free(status->fault_msg);
+		wsman_status_init(status);
 		rc = cc->ft->deleteInstance(cc, objectpath);
+		if (cim_retry_lookup(lookup, key, &rc)) {
+			CMRelease(objectpath);
+			objectpath = NULL;
+			continue;
+		}
 		if (rc.rc != 0) {
 			cim_to_wsman_status(rc, status);
+		} else if (key) {
+			sfcc_cache_forget(&cim_objectpath_cache, key);
 		}
 		debug("deleteInstance rc=%d, msg=%s", rc.rc,
 				(rc.msg) ? CMGetCharPtr(rc.msg) : NULL);
+		break;
 	}
 
 	debug("fault: %d %d", status->fault_code,
 			status->fault_detail_code);
 
-cleanup:
 	if (objectpath)
 		CMRelease(objectpath);
+	u_free(key);
 	return;
 }
 
@@ -1912,20 +3444,33 @@ cim_get_instance_from_enum(CimClientInfo * client,
 		WsXmlNodeH body, char *fragstr, WsmanStatus * status)
 {
 	CMPIInstance *instance;
-	CMPIObjectPath *objectpath;
+	CMPIObjectPath *objectpath = NULL;
 	CMPIStatus rc;
 	CMCIClient *cc = (CMCIClient *) client->cc;
+	char *key;
+	int lookup;
 
 	if (!cc) {
-		goto cleanup;
+		return;
 	}
 
-	if ((objectpath = cim_get_op_from_enum(client, status)) != NULL) {
-	        u_free(status->fault_msg);
-	        wsman_status_init(status);
+	key = cim_objectpath_cache_key(client);
+	for (lookup = 0; lookup < SFCC_OP_LOOKUPS; lookup++) {
+		objectpath = cim_lookup_op(client, lookup, key, status);
+		if (objectpath == NULL)
+			continue;
+		u_free(status->fault_msg);
+		wsman_status_init(status);
 		instance = cc->ft->getInstance(cc, objectpath,
 				CMPI_FLAG_IncludeClassOrigin,
 				NULL, &rc);
+		if (cim_retry_lookup(lookup, key, &rc)) {
+			if (instance)
+				CMRelease(instance);
+			CMRelease(objectpath);
+			objectpath = NULL;
+			continue;
+		}
 		if (rc.rc == 0) {
 			if (instance) {
 				instance2xml(client, instance, fragstr, body, NULL);
@@ -1937,6 +3482,7 @@ cim_get_instance_from_enum(CimClientInfo * client,
 				(rc.msg) ? CMGetCharPtr(rc.msg) : NULL);
 		if (instance)
 			CMRelease(instance);
+		break;
 	}
 
 	debug("fault: %d %d", status->fault_code,
@@ -1944,7 +3490,7 @@ cim_get_instance_from_enum(CimClientInfo * client,
 
 	if (objectpath)
 		CMRelease(objectpath);
-cleanup:
+	u_free(key);
 	return;
 }
 
@@ -2268,11 +3814,10 @@ cim_get_indicationfilter_objectpath_from_selectors(CimClientInfo * client,
 
     if(objectpath) {
         CMPIStatus rc;
-        CMCIClient *cc = (CMCIClient *)client->cc;
-        class = cc->ft->getClass(cc,
-                                 objectpath,
+        class = cim_get_cached_class(client,
+                                 get_indication_profile_implementation_ns(),
+                                 client->requested_class,
                                  CMPI_FLAG_IncludeQualifiers,
-                                 NULL,
                                  &rc);
         if (!class){
             CMRelease(objectpath);
@@ -2736,17 +4281,17 @@ cim_release_enum_context(WsEnumerateInfo * enumInfo)
 
 	debug("releasing enumInfo->appEnumContext");
 	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
-	CMPIEnumeration *enumeration;
-	CimClientInfo *client;
 
-	enumeration = enumcontext->ecEnumeration;
-	client = enumcontext->ecClient;
-
-	if (enumeration) {
-		debug("released enumeration");
-		CMRelease(enumeration);
-	}
+	cim_enum_release_enumerations(enumcontext);
+	/* the filtered copy is ours, other arrays belong to the enumeration */
+	if (enumInfo->enumResults && (enumInfo->flags & WSMAN_ENUMINFO_SELECTOR))
+		CMRelease((CMPIArray *) enumInfo->enumResults);
+	enumInfo->enumResults = NULL;
+	u_free(enumcontext->ecWindow);
+	u_free(enumcontext->ecFragment);
+	cim_enum_drop_rendered(enumcontext);
 	u_free(enumcontext);
+	enumInfo->appEnumContext = NULL;
 }
 
 CimClientInfo *
@@ -2850,6 +4395,8 @@ cim_get_enum_items(CimClientInfo * client,
 {
 	WsXmlNodeH itemsNode;
 	WsXmlDocH outdoc = NULL;
+	WsXmlSize envsize;
+	sfcc_enumcontext *enumcontext = enumInfo->appEnumContext;
         int c;
         int count = 0;
 	if (node == NULL)
@@ -2860,44 +4407,53 @@ cim_get_enum_items(CimClientInfo * client,
 	debug("enum flags: %lu", enumInfo->flags );
 
 	outdoc = ws_xml_get_node_doc(node);
+	if (enumcontext)
+		enumcontext->ecBatch = maxelements;
+	if (enumcontext && enumcontext->ecWindow) {
+		/* one more than fits in this response tells about EndOfSequence */
+		cim_enum_prefetch(enumInfo, maxelements > 0 ? maxelements + 1 : 0);
+	}
 	if (enumInfo->totalItems > 0) {
                 if (maxelements <= 0) {
                         maxelements = -1; /* don't check maxelements */
                 }
+		if (maxsize > 0)
+			ws_xml_size_init(&envsize, outdoc, enumInfo->encoding);
 		while (enumInfo->index >= 0 &&
 				enumInfo->index < enumInfo->totalItems) {
-			if (enumInfo->flags & WSMAN_ENUMINFO_EPR ) {
-				c = cim_getEprAt(client, enumInfo, itemsNode);
-			} else if (enumInfo->flags & WSMAN_ENUMINFO_OBJEPR) {
-				c = cim_getEprObjAt(client, enumInfo, itemsNode);
-			} else {
-				c = cim_getElementAt(client, enumInfo, itemsNode);
-			}
+			c = cim_enum_render(client, enumInfo, itemsNode);
                         if (!c) {
                                 /* cim_getE... failed */
                                 break;
                         }
-			if (check_envelope_size(outdoc, maxsize, enumInfo->encoding)) {
+			if (maxsize > 0 &&
+			    ws_xml_size_add(&envsize, xml_parser_node_get(itemsNode,
+					    XML_LAST_CHILD)) > maxsize) {
                                 /* last item added to itemsNode exceeded the envelope size */
                                 if (count > 0) {
                                         /* if there's already a partial result,
                                          * remove last child from itemsNode
                                          * and return partial result */
                                         WsXmlNodeH item = xml_parser_node_get(itemsNode, XML_LAST_CHILD);
-                                        xml_parser_node_remove(item);
+                                        ws_xml_size_remove(&envsize, item);
                                 }
                                 /* if the first item already exceeds the envelope size, leave it
                                  * and let the SOAP report an EncodingLimit fault.
                                  */
 				break;
 			}
-			enumInfo->index++;
+			cim_enum_advance(enumInfo);
                         count++;
 			maxelements--;
                         if (maxelements == 0) {
                                 break;
                         }
 		}
+		if (enumcontext && enumcontext->ecWindow) {
+			cim_enum_prefetch(enumInfo, 1);
+		}
+		if (enumcontext)
+			cim_enum_account(enumInfo);
 		enumInfo->index--; /* callee (wsman-soap.c) increments it again */
 	}
 	enumInfo->pullResultPtr = outdoc;
@@ -23,6 +23,22 @@ CMCIClient *cim_connect_to_cimom(char *cim_host, char *cim_port,
 				 char * frontend,
 				 WsmanStatus * status);
 
+CMCIClient *cim_get_pooled_client(char *cim_host, char *cim_port,
+				 char *cim_host_userid,
+				 char *cim_host_passwd,
+				 char * frontend,
+				 WsmanStatus * status);
+
+void cim_put_pooled_client(CMCIClient * cc, char *cim_host, char *cim_port,
+				 char *cim_host_userid,
+				 char *cim_host_passwd,
+				 char * frontend);
+
+void cim_release_client_pool(void);
+
+void cim_class_cache_flush(void);
+void cim_objectpath_cache_flush(void);
+
 void cim_release_client(CimClientInfo * cimclient);
 
 void release_cmpi_data(CMPIData data);
@@ -71,7 +71,9 @@ char *shttpd_reason_phrase(int code)
         {404, "Not found"},
         {500, "Internal Error"},
         {501, "Not implemented"},
+        {413, "Request Entity Too Large"},
         {415, "Unsupported Media Type"},
+        {503, "Service Unavailable"},
         {0, NULL}
     };
     int i = 0;
@@ -11,6 +11,10 @@
 #include <sys/wait.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <poll.h>
+#endif /* HAVE_SYS_EPOLL_H */
 #include <sys/mman.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -18,6 +22,7 @@
 
 #include <pwd.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <dirent.h>
 #include <dlfcn.h>
 #ifndef SSL_LIB
@@ -30,6 +35,7 @@
 #define	ERRNO				errno
 #define	NO_GUI
 
-#define	InitializeCriticalSection(x)	/* FIXME UNIX version is not MT safe */
-#define	EnterCriticalSection(x)
-#define	LeaveCriticalSection(x)
+#define	CRITICAL_SECTION		pthread_mutex_t
+#define	InitializeCriticalSection(x)	pthread_mutex_init((x), NULL)
+#define	EnterCriticalSection(x)		pthread_mutex_lock(x)
+#define	LeaveCriticalSection(x)		pthread_mutex_unlock(x)
@@ -111,6 +111,9 @@ set_ssl(struct shttpd_ctx *ctx, void *arg, const char *pem)
 		elog(E_FATAL, NULL, "cannot open %s : %s", pem, strerror(errno));
 	else if (wsmand_options_get_ssl_key_file() && SSL_CTX_use_PrivateKey_file(CTX, wsmand_options_get_ssl_key_file(), SSL_FILETYPE_PEM) == 0)
 		elog(E_FATAL, NULL, "cannot open %s : %s", pem, strerror(errno));
+	ssl_setup_sessions(CTX, wsmand_options_get_ssl_session_cache_size(),
+	    wsmand_options_get_ssl_session_timeout(),
+	    wsmand_options_get_ssl_ticket_key_lifetime());
 	ctx->ssl_ctx = CTX;
 }
 #endif /* NO_SSL */
@@ -165,6 +168,10 @@ const struct opt options[] = {
 		OFS(aliases), "X=Y,...", NULL, OPT_ADVANCED},
 	{'b', "io_buf_size", "IO buffer size", set_int, OFS(io_buf_size),
 		"bytes", DFLT_IO_SIZ, OPT_INT | OPT_ADVANCED},
+	{'K', "keep_alive_requests", "Keep-alive requests per connection",
+		set_int, OFS(keep_alive_requests), "num", KEEP_ALIVE_REQUESTS, OPT_INT | OPT_ADVANCED},
+	{'T', "keep_alive_timeout", "Keep-alive idle timeout", set_int,
+		OFS(keep_alive_timeout), "seconds", KEEP_ALIVE_TIMEOUT, OPT_INT | OPT_ADVANCED},
 	{'x', "acl", "Allow/deny IP addresses/subnets", set_acl,
 		OFS(acl), "acl_list", NULL, OPT_ADVANCED},
 #ifdef _WIN32
@@ -235,6 +242,44 @@ initialize_context(struct shttpd_ctx *ctx, const char *config_file,
 	LL_INIT(&ctx->uri_auths);
 	LL_INIT(&ctx->error_handlers);
 	LL_INIT(&ctx->acl);
+	LL_INIT(&ctx->woken);
+
+	/*
+	 * shttpd_wakeup() writes to this pipe to interrupt shttpd_poll().
+	 * Windows cannot select() on a pipe, woken up connections are
+	 * picked up there when the poll times out.
+	 */
+	ctx->wake[0] = ctx->wake[1] = -1;
+#if !defined(_WIN32)
+	if (pipe(ctx->wake) != 0) {
+		elog(E_LOG, NULL, "pipe: %s", strerror(errno));
+		ctx->wake[0] = ctx->wake[1] = -1;
+	} else {
+		(void) set_non_blocking_mode(ctx->wake[0]);
+		(void) set_non_blocking_mode(ctx->wake[1]);
+		set_close_on_exec(ctx->wake[0]);
+		set_close_on_exec(ctx->wake[1]);
+	}
+#endif /* !_WIN32 */
+#ifdef USE_EPOLL
+	LL_INIT(&ctx->ready);
+	if ((ctx->epfd = epoll_create(EPOLL_EVENTS)) == -1) {
+		elog(E_LOG, NULL, "epoll_create: %s, using select()",
+		    strerror(errno));
+	} else {
+		set_close_on_exec(ctx->epfd);
+		if (ctx->wake[0] != -1) {
+			struct epoll_event	ev;
+
+			ev.events = EPOLLIN;
+			ev.data.ptr = ctx->wake;
+			if (epoll_ctl(ctx->epfd, EPOLL_CTL_ADD,
+			    ctx->wake[0], &ev) != 0)
+				elog(E_LOG, NULL, "epoll_ctl: %s",
+				    strerror(errno));
+		}
+	}
+#endif /* USE_EPOLL */
 
 #if !defined(NO_SSI)
 	LL_INIT(&ctx->ssi_funcs);
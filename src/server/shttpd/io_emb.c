@@ -33,6 +33,13 @@ call_user(struct conn *c, struct shttpd_arg *arg, shttpd_callback_t func)
 	arg->in.len		= io_data_len(&c->rem.io);
 	arg->in.num_bytes	= 0;
 
+	/* Do not hand a pipelined request to the callback as POST data */
+	if (c->rem.content_len > 0) {
+		big_int_t delivered = c->rem.io.total - arg->in.len;
+		if (delivered + arg->in.len > c->rem.content_len)
+			arg->in.len = c->rem.content_len - delivered;
+	}
+
 	if (io_data_len(&c->rem.io) >= c->rem.io.size) {
 		arg->flags |= SHTTPD_POST_BUFFER_FULL;
 	}
@@ -47,6 +54,18 @@ call_user(struct conn *c, struct shttpd_arg *arg, shttpd_callback_t func)
 	io_inc_tail(&c->rem.io, arg->in.num_bytes);
 	c->loc.chan.emb.state = arg->state;		/* Save state */
 
+	if (arg->flags & SHTTPD_CLOSE_CONNECTION)
+		c->keep_alive = 0;
+
+	/*
+	 * Do not call the callback again until shttpd_wakeup(), or until
+	 * the shttpd_set_output() data is sent
+	 */
+	if (arg->flags & SHTTPD_SUSPEND)
+		c->loc.flags |= FLAG_SUSPENDED;
+	if ((arg->flags & SHTTPD_SUSPEND) || c->ext_out_len > 0)
+		c->loc.flags &= ~FLAG_ALWAYS_READY;
+
 	/*
 	 * If callback finished output, that means it did all cleanup.
 	 * If the connection is terminated unexpectedly, we canna call
@@ -73,6 +92,10 @@ do_embedded(struct stream *stream, void *buf, size_t len)
 	struct shttpd_arg	arg;
 	buf = NULL; len = 0;		/* Squash warnings */
 
+	if ((stream->conn->loc.flags & FLAG_SUSPENDED) ||
+	    stream->conn->ext_out_len > 0)
+		return (0);
+
 	arg.user_data	= stream->conn->loc.chan.emb.data;
 	arg.flags	= 0;
 
@@ -100,6 +123,42 @@ close_embedded(struct stream *stream)
 		    c->loc.chan.emb.func.v_func);
 }
 
+void *
+shttpd_suspend(struct shttpd_arg *arg)
+{
+	arg->flags |= SHTTPD_SUSPEND;
+
+	return (arg->priv);
+}
+
+/*
+ * May be called from any thread. The connection is resumed by the
+ * thread that polls its context.
+ */
+void
+shttpd_wakeup(void *conn)
+{
+	struct conn		*c = conn;
+	struct shttpd_ctx	*ctx = c->ctx;
+
+	EnterCriticalSection(&ctx->mutex);
+	if (LL_EMPTY(&c->wake_link))
+		LL_TAIL(&ctx->woken, &c->wake_link);
+	LeaveCriticalSection(&ctx->mutex);
+
+	if (ctx->wake[1] != -1)
+		(void) write(ctx->wake[1], "", 1);
+}
+
+void
+shttpd_set_output(struct shttpd_arg *arg, const void *buf, size_t len)
+{
+	struct conn	*c = arg->priv;
+
+	c->ext_out = buf;
+	c->ext_out_len = len;
+}
+
 size_t
 shttpd_printf(struct shttpd_arg *arg, const char *fmt, ...)
 {
@@ -192,6 +251,14 @@ shttpd_get_http_version(struct shttpd_arg *arg, unsigned long *major, unsigned l
 	*minor = c->minor_version;
 }
 
+int
+shttpd_keep_alive(struct shttpd_arg *arg)
+{
+	struct conn *c = arg->priv;
+
+	return (c->keep_alive && !(arg->flags & SHTTPD_CLOSE_CONNECTION));
+}
+
 void
 shttpd_register_uri(struct shttpd_ctx *ctx,
 		const char *uri, shttpd_callback_t callback, void *data)
@@ -28,9 +28,202 @@ struct ssl_func	ssl_sw[] = {
 	{"SSL_CTX_free", {0}},
 	{"SSL_pending", {0}},
 	{"SSL_CTX_use_certificate_chain_file",{0}},
+	{"SSL_CTX_ctrl",		{0}},
+	{"SSL_CTX_set_session_id_context",{0}},
+	{"SSL_CTX_set_timeout",		{0}},
+	{"SSL_set_shutdown",		{0}},
 	{NULL,				{0}}
 };
 
+#ifdef HAVE_OPENSSL
+/*
+ * Session ticket keys. They are shared by all contexts, so that a ticket
+ * issued by one I/O thread is accepted by the others. A new key is made
+ * every ticket_lifetime seconds; tickets sealed with the previous key are
+ * still accepted, and renewed, for one more period.
+ */
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+
+struct ticket_key {
+	unsigned char	name[16];
+	unsigned char	aes[32];
+	unsigned char	hmac[32];
+	time_t		created;
+};
+
+static pthread_mutex_t	ticket_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ticket_key ticket_keys[2];	/* Current, previous */
+static int		ticket_lifetime;
+
+static int
+new_ticket_key(struct ticket_key *key, time_t now)
+{
+	if (RAND_bytes(key->name, sizeof(key->name)) != 1 ||
+	    RAND_bytes(key->aes, sizeof(key->aes)) != 1 ||
+	    RAND_bytes(key->hmac, sizeof(key->hmac)) != 1)
+		return (-1);
+	key->created = now;
+	return (0);
+}
+
+/*
+ * Find the key for the ticket (enc == 0) or the one to seal a new
+ * ticket with (enc == 1), rotating if it is due. Returns 1 for the
+ * current key, 2 for the previous one, 0 if there is none.
+ */
+static int
+get_ticket_key(unsigned char *name, int enc, struct ticket_key *out)
+{
+	time_t	now = time(NULL);
+	int	rc = 0;
+
+	pthread_mutex_lock(&ticket_lock);
+	if (ticket_keys[0].created == 0 ||
+	    now - ticket_keys[0].created >= ticket_lifetime) {
+		ticket_keys[1] = ticket_keys[0];
+		if (new_ticket_key(&ticket_keys[0], now) != 0)
+			ticket_keys[0].created = 0;
+	}
+	if (enc) {
+		if (ticket_keys[0].created != 0) {
+			*out = ticket_keys[0];
+			rc = 1;
+		}
+	} else if (ticket_keys[0].created != 0 &&
+	    memcmp(name, ticket_keys[0].name, 16) == 0) {
+		*out = ticket_keys[0];
+		rc = 1;
+	} else if (ticket_keys[1].created != 0 &&
+	    memcmp(name, ticket_keys[1].name, 16) == 0) {
+		*out = ticket_keys[1];
+		rc = 2;		/* Tells OpenSSL to issue a fresh ticket */
+	}
+	pthread_mutex_unlock(&ticket_lock);
+
+	return (rc);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX	TICKET_MAC_CTX;
+
+static int
+init_ticket_mac(EVP_MAC_CTX *mctx, unsigned char *key, size_t len)
+{
+	OSSL_PARAM	params[3];
+
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+	    key, len);
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+	    "SHA256", 0);
+	params[2] = OSSL_PARAM_construct_end();
+
+	return (EVP_MAC_CTX_set_params(mctx, params));
+}
+#else
+typedef HMAC_CTX	TICKET_MAC_CTX;
+
+static int
+init_ticket_mac(HMAC_CTX *mctx, unsigned char *key, size_t len)
+{
+	return (HMAC_Init_ex(mctx, key, len, EVP_sha256(), NULL));
+}
+#endif
+
+static int
+ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv,
+		EVP_CIPHER_CTX *cctx, TICKET_MAC_CTX *mctx, int enc)
+{
+	struct ticket_key	key;
+	int			rc;
+
+	if ((rc = get_ticket_key(name, enc, &key)) == 0)
+		return (enc ? -1 : 0);
+
+	if (enc) {
+		if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1)
+			return (-1);
+		(void) memcpy(name, key.name, sizeof(key.name));
+		if (EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL,
+		    key.aes, iv) != 1)
+			return (-1);
+	} else if (EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL,
+	    key.aes, iv) != 1) {
+		return (-1);
+	}
+	if (init_ticket_mac(mctx, key.hmac, sizeof(key.hmac)) != 1)
+		return (-1);
+#ifdef TLS1_3_VERSION
+	/*
+	 * TLS 1.3 clients use a ticket only once: unless we renew it,
+	 * OpenSSL sends no new ticket after a resumed handshake.
+	 */
+	if (!enc && SSL_version(ssl) >= TLS1_3_VERSION)
+		rc = 2;
+#endif
+
+	return (rc);
+}
+#endif /* HAVE_OPENSSL */
+
+/*
+ * Set up session resumption: a server side session cache, and session
+ * tickets sealed with our own, rotated, keys.
+ */
+void
+ssl_setup_sessions(SSL_CTX *CTX, int cache_size, int timeout,
+		int ticket_key_lifetime)
+{
+	static const unsigned char sid_ctx[] = "openwsman";
+
+	(void) SSL_CTX_set_session_id_context(CTX, sid_ctx,
+	    sizeof(sid_ctx) - 1);
+	if (cache_size > 0) {
+		(void) SSL_CTX_ctrl(CTX, SSL_CTRL_SET_SESS_CACHE_MODE,
+		    SSL_SESS_CACHE_SERVER, NULL);
+		(void) SSL_CTX_ctrl(CTX, SSL_CTRL_SET_SESS_CACHE_SIZE,
+		    cache_size, NULL);
+	} else {
+		(void) SSL_CTX_ctrl(CTX, SSL_CTRL_SET_SESS_CACHE_MODE,
+		    SSL_SESS_CACHE_OFF, NULL);
+	}
+	if (timeout > 0)
+		(void) SSL_CTX_set_timeout(CTX, timeout);
+
+#ifdef HAVE_OPENSSL
+	/* Without our callback OpenSSL uses a per context, fixed key */
+	if (ticket_key_lifetime > 0) {
+		ticket_lifetime = ticket_key_lifetime;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		(void) SSL_CTX_set_tlsext_ticket_key_evp_cb(CTX, ticket_key_cb);
+#else
+		(void) SSL_CTX_set_tlsext_ticket_key_cb(CTX, ticket_key_cb);
+#endif
+	}
+#endif /* HAVE_OPENSSL */
+}
+
+void
+shttpd_get_ssl_stats(struct shttpd_ctx *ctx, struct shttpd_ssl_stats *st)
+{
+	SSL_CTX	*CTX = ctx->ssl_ctx;
+
+	(void) memset(st, 0, sizeof(*st));
+	if (CTX == NULL)
+		return;
+	st->handshakes = SSL_CTX_ctrl(CTX, SSL_CTRL_SESS_ACCEPT_GOOD, 0, NULL);
+	st->resumed = SSL_CTX_ctrl(CTX, SSL_CTRL_SESS_HIT, 0, NULL);
+	st->misses = SSL_CTX_ctrl(CTX, SSL_CTRL_SESS_MISSES, 0, NULL);
+	st->timeouts = SSL_CTX_ctrl(CTX, SSL_CTRL_SESS_TIMEOUTS, 0, NULL);
+	st->cache_full = SSL_CTX_ctrl(CTX, SSL_CTRL_SESS_CACHE_FULL, 0, NULL);
+	st->failed = SSL_CTX_ctrl(CTX, SSL_CTRL_SESS_ACCEPT, 0, NULL) -
+	    st->handshakes;
+}
+
 void
 ssl_handshake(struct stream *stream)
 {
@@ -81,6 +274,12 @@ close_ssl(struct stream *stream)
 	assert(stream->chan.ssl.ssl != NULL);
 	shutdown(stream->chan.ssl.sock,SHUT_RDWR);
 	(void) closesocket(stream->chan.ssl.sock);
+	/*
+	 * No close_notify is sent, but OpenSSL drops the session from the
+	 * cache unless the connection looks properly shut down.
+	 */
+	SSL_set_shutdown(stream->chan.ssl.ssl,
+	    SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
 	SSL_free(stream->chan.ssl.ssl);
 }
 
@@ -90,4 +289,11 @@ const struct io_class	io_ssl =  {
 	write_ssl,
 	close_ssl
 };
+#else
+
+void
+shttpd_get_ssl_stats(struct shttpd_ctx *ctx, struct shttpd_ssl_stats *st)
+{
+	(void) memset(st, 0, sizeof(*st));
+}
 #endif /* !NO_SSL */
@@ -26,6 +26,9 @@ time_t		current_time;	/* Current UTC time		*/
 int		tz_offset;	/* Time zone offset from UTC	*/
 
 static LL_HEAD(listeners);	/* List of listening sockets	*/
+#ifdef USE_EPOLL
+static int	listeners_gen;	/* Bumped when a listener is added */
+#endif /* USE_EPOLL */
 
 const struct vec known_http_methods[] = {
 /*	{"GET",		3}, */
@@ -41,8 +44,12 @@ struct listener {
 	struct shttpd_ctx *ctx;		/* Context that socket belongs	*/
 	int		sock;		/* Listening socket		*/
 	int		is_ssl;		/* Should be SSL-ed		*/
+	int		is_shard;	/* Only ctx accepts on it	*/
 };
 
+/* Whether ctx should accept connections on listener l */
+#define	LISTENS_ON(ctx, l)	(!(l)->is_shard || (l)->ctx == (ctx))
+
 /*
  * This structure tells how HTTP headers must be parsed.
  * Used by parse_headers() function.
@@ -155,10 +162,12 @@ stop_stream(struct stream *stream)
 }
 
 /*
- * Setup listening socket on given port, return socket
+ * Setup listening socket on given port, return socket. With reuseport,
+ * several sockets may be bound to the same port (SO_REUSEPORT) and the
+ * kernel balances the incoming connections between them.
  */
 static int
-open_listening_port(int port)
+open_listening_port(int port, int reuseport)
 {
 	int		sock = -1, on = 1;
 	struct usa	sa;
@@ -203,6 +212,16 @@ open_listening_port(int port)
 	if (setsockopt(sock, SOL_SOCKET,
 	    SO_REUSEADDR,(char *) &on, sizeof(on)) != 0)
 		goto fail;
+	if (reuseport) {
+#ifdef SO_REUSEPORT
+		if (setsockopt(sock, SOL_SOCKET,
+		    SO_REUSEPORT, (char *) &on, sizeof(on)) != 0)
+			goto fail;
+#else
+		errno = ENOPROTOOPT;
+		goto fail;
+#endif /* SO_REUSEPORT */
+	}
 	if (bind(sock, &sa.u.sa, sa.len) < 0)
 		goto fail;
 	if (listen(sock, 128) != 0)
@@ -268,6 +287,7 @@ send_server_error(struct conn *c, int status, const char *reason)
 #endif /* EMBEDDED */
 
 	io_clear(&c->loc.io);
+	c->keep_alive = 0;
 	c->loc.headers_len = c->loc.io.head = snprintf(c->loc.io.buf,
 	    c->loc.io.size, "HTTP/1.1 %d %s\r\nConnection: Close\r\n\r\n%d %s",
 	    status, reason, status, reason);
@@ -598,6 +618,26 @@ set_request_method(struct conn *c)
 	return (v->ptr == NULL);
 }
 
+/*
+ * Decide whether the connection may be reused after this request.
+ * HTTP/1.1 is persistent unless the client asks for "close",
+ * HTTP/1.0 only if the client explicitly asks for "keep-alive".
+ */
+static int
+is_keep_alive(const struct conn *c)
+{
+	const struct vec	*v = &c->ch.connection.v_vec;
+
+	if (c->ctx->keep_alive_requests <= 0 ||
+	    c->nrequests >= (unsigned long) c->ctx->keep_alive_requests)
+		return (0);
+
+	if (c->major_version == 1 && c->minor_version >= 1)
+		return (!(v->len == 5 && !strncasecmp(v->ptr, "close", 5)));
+
+	return (v->len == 10 && !strncasecmp(v->ptr, "keep-alive", 10));
+}
+
 static void
 parse_http_request(struct conn *c)
 {
@@ -683,6 +723,8 @@ parse_http_request(struct conn *c)
 		my_strlcpy(c->uri, (char *) start, uri_len + 1);
 		parse_headers(c->headers,
 		    (c->request + req_len) - c->headers, &c->ch);
+		c->nrequests++;
+		c->keep_alive = is_keep_alive(c);
 
 		/* Remove the length of request from total, count only data */
 		assert(c->rem.io.total >= (big_int_t) req_len);
@@ -730,6 +772,10 @@ shttpd_add_socket(struct shttpd_ctx *ctx, int sock, int is_ssl)
 		ctx->nrequests++;
 		c->rem.conn = c->loc.conn = c;
 		c->ctx		= ctx;
+#ifdef USE_EPOLL
+		LL_INIT(&c->ready_link);
+#endif /* USE_EPOLL */
+		LL_INIT(&c->wake_link);
 		c->sa		= sa;
 		c->birth_time	= current_time;
 		c->expire_time	= current_time + EXPIRE_TIME;
@@ -773,6 +819,23 @@ shttpd_add_socket(struct shttpd_ctx *ctx, int sock, int is_ssl)
 		LL_TAIL(&ctx->connections, &c->link);
 		ctx->nactive++;
 		LeaveCriticalSection(&ctx->mutex);
+#ifdef USE_EPOLL
+		/*
+		 * Edge-triggered: epoll reports the current readiness once
+		 * right after the socket is added, so the connection does not
+		 * have to be put on the ready list here (which is not safe
+		 * when called from the acceptor thread).
+		 */
+		if (ctx->epfd != -1) {
+			struct epoll_event	ev;
+
+			ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+			ev.data.ptr = c;
+			if (epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, sock, &ev) != 0)
+				elog(E_LOG, NULL, "add_socket: epoll_ctl: %s",
+				    strerror(ERRNO));
+		}
+#endif /* USE_EPOLL */
 #ifdef ENABLE_IPV6
 		if (wsmand_options_get_use_ipv6()) {
 			char str[INET6_ADDRSTRLEN];
@@ -799,14 +862,15 @@ shttpd_active(struct shttpd_ctx *ctx)
 /*
  * Setup a listening socket on given port. Return opened socket or -1
  */
-int
-shttpd_listen(struct shttpd_ctx *ctx, int port, int is_ssl)
+static int
+add_listener(struct shttpd_ctx *ctx, int port, int is_ssl, int is_shard)
 {
 	struct listener	*l;
 	int		sock;
 
-	if ((sock = open_listening_port(port)) == -1) {
-		elog(E_FATAL, NULL, "cannot open port %d", port);
+	if ((sock = open_listening_port(port, is_shard)) == -1) {
+		if (!is_shard)
+			elog(E_FATAL, NULL, "cannot open port %d", port);
 	} else if ((l = calloc(1, sizeof(*l))) == NULL) {
 		(void) closesocket(sock);
 		elog(E_FATAL, NULL, "cannot allocate listener");
@@ -816,22 +880,50 @@ shttpd_listen(struct shttpd_ctx *ctx, int port, int is_ssl)
 		    "please specify certificate file");
 	} else {
 		l->is_ssl = is_ssl;
+		l->is_shard = is_shard;
 		l->sock	= sock;
 		l->ctx	= ctx;
 		LL_TAIL(&listeners, &l->link);
+#ifdef USE_EPOLL
+		listeners_gen++;
+#endif /* USE_EPOLL */
 		DBG(("shttpd_listen: added socket %d", sock));
 	}
 
 	return (sock);
 }
 
+int
+shttpd_listen(struct shttpd_ctx *ctx, int port, int is_ssl)
+{
+	return (add_listener(ctx, port, is_ssl, 0));
+}
+
+int
+shttpd_listen_shard(struct shttpd_ctx *ctx, int port, int is_ssl)
+{
+	return (add_listener(ctx, port, is_ssl, 1));
+}
+
 int
 shttpd_accept(int lsn_sock, int milliseconds)
 {
-	struct timeval	tv;
 	struct usa	sa;
-	fd_set		read_set;
 	int		sock = -1;
+#ifdef USE_EPOLL
+	/* A single descriptor: poll() is enough, and not FD_SETSIZE bound */
+	struct pollfd	pfd;
+
+	sa.len		= sizeof(sa.u.sin);
+	pfd.fd		= lsn_sock;
+	pfd.events	= POLLIN;
+	pfd.revents	= 0;
+
+	if (poll(&pfd, 1, milliseconds) == 1)
+		sock = accept(lsn_sock, &sa.u.sa, &sa.len);
+#else
+	struct timeval	tv;
+	fd_set		read_set;
 
 	tv.tv_sec	= milliseconds / 1000;
 	tv.tv_usec	= milliseconds % 1000;
@@ -841,6 +933,7 @@ shttpd_accept(int lsn_sock, int milliseconds)
 
 	if (select(lsn_sock + 1, &read_set, NULL, NULL, &tv) == 1)
 		sock = accept(lsn_sock, &sa.u.sa, &sa.len);
+#endif /* USE_EPOLL */
 
 	return (sock);
 }
@@ -856,6 +949,9 @@ read_stream(struct stream *stream)
         if (stream->content_len > 0 &&
             stream->io.total + len > stream->content_len)
                 len = stream->content_len - stream->io.total;
+        /* Body is complete, leave a pipelined request in the socket */
+        if (len == 0)
+                return;
 
         /* Read from underlying channel */
         n = stream->nread_last = stream->io_class->read(stream,
@@ -872,13 +968,16 @@ read_stream(struct stream *stream)
                 if((stream->chan.ssl.ssl && sslerr == SSL_ERROR_SYSCALL &&
 					(ERRNO == EINTR || ERRNO == EWOULDBLOCK)) ||
 					(ERRNO == EINTR || ERRNO == EWOULDBLOCK)) {
-                                n = n; /* Ignore EINTR and EAGAIN */
+                                /* Ignore EINTR and EAGAIN */
+                                if (ERRNO == EWOULDBLOCK)
+                                        stream->flags &= ~FLAG_EV_READ;
                 }
                 else if(sslerr == SSL_ERROR_WANT_READ) {
-                        n = n;
+                        stream->flags &= ~FLAG_EV_READ;
                 }
                 else if(sslerr == SSL_ERROR_WANT_WRITE) {
                         stream->flags |= FLAG_SSL_SHOULD_SELECT_ON_WRITE;
+                        stream->flags &= ~FLAG_EV_WRITE;
                 }
                 else if (!(stream->flags & FLAG_DONT_CLOSE))
                         stop_stream(stream);
@@ -909,16 +1008,15 @@ read_stream(struct stream *stream)
 	stream->conn->expire_time = current_time + EXPIRE_TIME;
 }
 
-static void
-write_stream(struct stream *from, struct stream *to)
+static int
+write_buf(struct stream *to, const char *buf, int len)
 {
-        int     n, len;
+        int     n;
         int sslerr = 0;
-        len = io_data_len(&from->io);
         assert(len > 0);
 
         /* TODO: should be assert on CAN_WRITE flag */
-        n = to->io_class->write(to, io_data(&from->io), len);
+        n = to->io_class->write(to, buf, len);
         to->conn->expire_time = current_time + EXPIRE_TIME;
         /*
         DBG(("write_stream (%d %s): written %d/%d bytes (errno %d)",
@@ -927,7 +1025,6 @@ write_stream(struct stream *from, struct stream *to)
                 */
 
         if (n > 0) {
-                io_inc_tail(&from->io, n);
                 to->flags &= ~FLAG_SSL_SHOULD_SELECT_ON_READ;
         }
         else if (n == -1) {
@@ -938,13 +1035,16 @@ write_stream(struct stream *from, struct stream *to)
                 if((to->chan.ssl.ssl && sslerr == SSL_ERROR_SYSCALL &&
 					(ERRNO == EINTR || ERRNO == EWOULDBLOCK)) ||
 					(ERRNO == EINTR || ERRNO == EWOULDBLOCK)) {
-                                n = n; /* Ignore EINTR and EAGAIN */
+                                /* Ignore EINTR and EAGAIN */
+                                if (ERRNO == EWOULDBLOCK)
+                                        to->flags &= ~FLAG_EV_WRITE;
                 }
                 else if(sslerr == SSL_ERROR_WANT_WRITE) {
-                        n = n;
+                        to->flags &= ~FLAG_EV_WRITE;
                 }
                 else if(sslerr == SSL_ERROR_WANT_READ) {
                         to->flags |= FLAG_SSL_SHOULD_SELECT_ON_READ;
+                        to->flags &= ~FLAG_EV_READ;
                 }
 
                 else if (!(to->flags & FLAG_DONT_CLOSE))
@@ -952,15 +1052,99 @@ write_stream(struct stream *from, struct stream *to)
         }
         else if (!(to->flags & FLAG_DONT_CLOSE))
                 stop_stream(to);
+
+        return (n);
 }
 
+static void
+write_stream(struct stream *from, struct stream *to)
+{
+        int     n;
 
+        n = write_buf(to, io_data(&from->io), io_data_len(&from->io));
+        if (n > 0)
+                io_inc_tail(&from->io, n);
+}
+
+/*
+ * Send the shttpd_set_output() data once the buffered output is gone,
+ * then let the callback continue.
+ */
+static void
+write_output(struct conn *c)
+{
+        int     n;
+
+        n = write_buf(&c->rem, c->ext_out, c->ext_out_len > INT_MAX ?
+            INT_MAX : (int) c->ext_out_len);
+        if (n > 0) {
+                c->ext_out += n;
+                c->ext_out_len -= n;
+                c->ctx->out += n;
+        }
+        if (c->ext_out_len == 0) {
+                c->ext_out = NULL;
+                if (!(c->loc.flags & (FLAG_CLOSED | FLAG_SUSPENDED)))
+                        c->loc.flags |= FLAG_ALWAYS_READY;
+        }
+}
+
+
+
+#ifdef USE_EPOLL
+/*
+ * With edge-triggered notification a connection gets no new event while
+ * it still has buffered work, or while the socket has not returned EAGAIN
+ * yet. Such connections are kept on ctx->ready and processed without
+ * waiting, so shttpd_poll() never has to scan all connections.
+ */
+static int
+wants_processing(struct conn *c)
+{
+	/*
+	 * read_stream() stops short of EAGAIN once the body is in, and
+	 * nothing is read while the request is suspended: FLAG_EV_READ is
+	 * kept for a pipelined request but must not count until then.
+	 */
+	int	readable = !(c->loc.flags & FLAG_SUSPENDED) &&
+	    !(c->rem.content_len > 0 &&
+	    (big_int_t) c->rem.io.total >= c->rem.content_len);
+
+	if (readable && (c->rem.flags & FLAG_EV_READ) &&
+	    io_space_len(&c->rem.io) &&
+	    !(c->rem.flags & FLAG_SSL_SHOULD_SELECT_ON_READ))
+		return (1);
+	if ((c->rem.flags & FLAG_EV_WRITE) &&
+	    (c->rem.flags & FLAG_SSL_SHOULD_SELECT_ON_WRITE))
+		return (1);
+	if ((io_data_len(&c->loc.io) || c->ext_out_len) &&
+	    ((c->rem.flags & FLAG_EV_WRITE) ||
+	    ((c->rem.flags & FLAG_SSL_SHOULD_SELECT_ON_READ) &&
+	    (c->rem.flags & FLAG_EV_READ))))
+		return (1);
+	if (c->rem.chan.ssl.ssl && SSL_pending(c->rem.chan.ssl.ssl))
+		return (1);
+	if ((c->loc.flags & FLAG_ALWAYS_READY) &&
+	    (((c->loc.flags & FLAG_R) && io_space_len(&c->loc.io)) ||
+	    ((c->loc.flags & FLAG_W) && io_data_len(&c->rem.io))))
+		return (1);
+
+	return (0);
+}
+
+static void
+update_ready(struct conn *c)
+{
+	if (c->ctx->epfd != -1 && LL_EMPTY(&c->ready_link) &&
+	    wants_processing(c))
+		LL_TAIL(&c->ctx->ready, &c->ready_link);
+}
+#endif /* USE_EPOLL */
 
 static void
 disconnect(struct llhead *lp)
 {
 	struct conn		*c = LL_ENTRY(lp, struct conn, link);
-	static const struct vec	ka = {"keep-alive", 10};
 	int			dont_close;
 
 	DBG(("Disconnecting %d (%.*s)", c->rem.chan.sock,
@@ -979,12 +1163,13 @@ disconnect(struct llhead *lp)
 		c->loc.io_class->close(&c->loc);
 
 	/*
-	 * Check the "Connection: " header before we free c->request
-	 * If it its 'keep-alive', then do not close the connection
+	 * c->keep_alive was decided from the "Connection: " header when
+	 * the request was parsed, and cleared if the reply could not be
+	 * delimited. Never reuse a connection the client has closed or
+	 * that timed out in the middle of a request.
 	 */
-	dont_close =  c->ch.connection.v_vec.len >= ka.len &&
-	    !strncasecmp(ka.ptr, c->ch.connection.v_vec.ptr, ka.len);
-	dont_close = 0;
+	dont_close = c->keep_alive && !(c->rem.flags & FLAG_CLOSED) &&
+	    current_time <= c->expire_time;
 	if (c->request)
 		free(c->request);
 	if (c->uri)
@@ -992,21 +1177,50 @@ disconnect(struct llhead *lp)
 
 	/* Handle Keep-Alive */
 	if (dont_close) {
+		DBG(("Keeping %d alive, %lu requests served",
+		    c->rem.chan.sock, c->nrequests));
 		c->loc.io_class = NULL;
 		c->loc.flags = 0;
-		c->rem.flags = FLAG_W | FLAG_R;
+		c->loc.headers_len = c->loc.nread_last = 0;
+		c->loc.content_len = 0;
+		c->rem.flags = FLAG_W | FLAG_R | (c->rem.flags &
+		    (FLAG_SSL_ACCEPTED | FLAG_EV_READ | FLAG_EV_WRITE));
+		c->rem.headers_len = c->rem.nread_last = 0;
+		c->rem.content_len = 0;
+		/* Whatever is left in the buffer belongs to the next request */
+		c->rem.io.total = io_data_len(&c->rem.io);
 		c->query = c->request = c->uri = c->path_info = NULL;
+		c->headers = NULL;
 		c->mime_type = NULL;
+		c->ext_out = NULL;
+		c->ext_out_len = 0;
+		c->status = 0;
+		c->keep_alive = 0;
+		c->expire_time = current_time + c->ctx->keep_alive_timeout;
 		(void) memset(&c->ch, 0, sizeof(c->ch));
 		io_clear(&c->loc.io);
+		c->ctx->nrequests++;
 		if (io_data_len(&c->rem.io) > 0)
 			process_connection(c, 0, 0);
+#ifdef USE_EPOLL
+		else
+			update_ready(c);
+#endif /* USE_EPOLL */
 	} else {
+#ifdef USE_EPOLL
+		if (c->ctx->epfd != -1) {
+			LL_DEL(&c->ready_link);
+			if (c->rem.io_class != NULL)
+				(void) epoll_ctl(c->ctx->epfd, EPOLL_CTL_DEL,
+				    c->rem.chan.sock, NULL);
+		}
+#endif /* USE_EPOLL */
 		if (c->rem.io_class != NULL)
 			c->rem.io_class->close(&c->rem);
 
 		EnterCriticalSection(&c->ctx->mutex);
 		LL_DEL(&c->link);
+		LL_DEL(&c->wake_link);
 		c->ctx->nactive--;
 		assert(c->ctx->nactive >= 0);
 		LeaveCriticalSection(&c->ctx->mutex);
@@ -1063,7 +1277,7 @@ process_connection(struct conn *c, int remote_ready, int local_ready)
 #endif
 
 	/* Read from remote end if it is ready */
-		if(c->loc.flags & FLAG_RESPONSE_COMPLETE)
+		if((c->loc.flags & FLAG_RESPONSE_COMPLETE) && !c->keep_alive)
 				c->rem.flags &= ~ FLAG_HEADERS_PARSED;
 	if (remote_ready && io_space_len(&c->rem.io))
 		read_stream(&c->rem);
@@ -1082,6 +1296,10 @@ process_connection(struct conn *c, int remote_ready, int local_ready)
 	if (io_data_len(&c->loc.io) > 0 && c->rem.io_class != NULL)
 		write_stream(&c->loc, &c->rem);
 
+	if (c->ext_out_len > 0 && io_data_len(&c->loc.io) == 0 &&
+	    c->rem.io_class != NULL)
+		write_output(c);
+
 	if (c->rem.nread_last > 0)
 		c->ctx->in += c->rem.nread_last;
 	if (c->loc.nread_last > 0)
@@ -1092,7 +1310,175 @@ process_connection(struct conn *c, int remote_ready, int local_ready)
 	    (c->rem.flags & FLAG_CLOSED) ||
 	    ((c->loc.flags & FLAG_CLOSED) && !io_data_len(&c->loc.io)))
 		disconnect(&c->link);
+#ifdef USE_EPOLL
+	else
+		update_ready(c);
+#endif /* USE_EPOLL */
+}
+
+/*
+ * Resume the connections passed to shttpd_wakeup() since the last poll
+ */
+static void
+resume_connections(struct shttpd_ctx *ctx)
+{
+	struct llhead	*lp, *tmp;
+	struct conn	*c;
+	char		buf[64];
+
+	if (ctx->wake[0] != -1)
+		while (read(ctx->wake[0], buf, sizeof(buf)) > 0)
+			continue;
+
+	EnterCriticalSection(&ctx->mutex);
+	LL_FOREACH_SAFE(&ctx->woken, lp, tmp) {
+		c = LL_ENTRY(lp, struct conn, wake_link);
+		LL_DEL(&c->wake_link);
+		if (!(c->loc.flags & FLAG_SUSPENDED))
+			continue;
+		c->loc.flags &= ~FLAG_SUSPENDED;
+		if (!(c->loc.flags & FLAG_CLOSED))
+			c->loc.flags |= FLAG_ALWAYS_READY;
+#ifdef USE_EPOLL
+		update_ready(c);
+#endif /* USE_EPOLL */
+	}
+	LeaveCriticalSection(&ctx->mutex);
+}
+
+/*
+ * Accept all pending connections on a listening socket
+ */
+static void
+accept_connections(struct shttpd_ctx *ctx, struct listener *l)
+{
+	struct usa	sa;
+	int		sock;
+
+	do {
+		sa.len = sizeof(sa.u.sin);
+		if ((sock = accept(l->sock, &sa.u.sa, &sa.len)) != -1) {
+#if defined(_WIN32)
+			shttpd_add_socket(ctx, sock, l->is_ssl);
+#else
+			if (
+#ifdef USE_EPOLL
+			    ctx->epfd == -1 &&
+#endif /* USE_EPOLL */
+			    sock >= (int) FD_SETSIZE) {
+				elog(E_LOG, NULL,
+				   "shttpd_poll: ctx %p: disarding "
+				   "socket %d, too busy", ctx, sock);
+				(void) closesocket(sock);
+			} else if (!is_allowed(ctx, &sa)) {
+				//elog(E_LOG, NULL, "shttpd_poll: %s is not allowed to connect",   inet_ntoa(sa.u.sin.sin_addr));
+				(void) closesocket(sock);
+			} else {
+				shttpd_add_socket(ctx, sock, l->is_ssl);
+			}
+#endif /* _WIN32 */
+		}
+	} while (sock != -1);
+}
+
+#ifdef USE_EPOLL
+/*
+ * epoll flavour of shttpd_poll(). Only connections that got an event,
+ * or that still have work queued on ctx->ready, are processed.
+ */
+static void
+poll_epoll(struct shttpd_ctx *ctx, int milliseconds)
+{
+	struct epoll_event	events[EPOLL_EVENTS], ev;
+	struct llhead		*lp, *tmp, batch;
+	struct listener		*l;
+	struct conn		*c;
+	int			i, n, woken = 0;
+
+	/* Listening sockets are shared by all contexts, level-triggered */
+	if (ctx->listeners_gen != listeners_gen) {
+		LL_FOREACH(&listeners, lp) {
+			l = LL_ENTRY(lp, struct listener, link);
+			if (!LISTENS_ON(ctx, l))
+				continue;
+			ev.events = EPOLLIN;
+			ev.data.ptr = l;
+			if (epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, l->sock, &ev) &&
+			    ERRNO != EEXIST)
+				elog(E_LOG, NULL, "poll_epoll: epoll_ctl: %s",
+				    strerror(ERRNO));
+		}
+		ctx->listeners_gen = listeners_gen;
+	}
+
+	n = epoll_wait(ctx->epfd, events, NELEMS(events),
+	    LL_EMPTY(&ctx->ready) ? milliseconds : 0);
+	if (n < 0 && ERRNO != EINTR)
+		DBG(("epoll_wait: %d", ERRNO));
+	current_time = time(0);
+
+	for (i = 0; i < n; i++) {
+		if (events[i].data.ptr == ctx->wake) {
+			woken++;
+			continue;
+		}
+		LL_FOREACH(&listeners, lp)
+			if (events[i].data.ptr == LL_ENTRY(lp,
+			    struct listener, link))
+				break;
+		if (lp != &listeners) {
+			accept_connections(ctx,
+			    LL_ENTRY(lp, struct listener, link));
+			continue;
+		}
+
+		c = events[i].data.ptr;
+		if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			c->rem.flags |= FLAG_EV_READ;
+		if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+			c->rem.flags |= FLAG_EV_WRITE;
+		if (LL_EMPTY(&c->ready_link))
+			LL_TAIL(&ctx->ready, &c->ready_link);
+	}
+
+	if (woken)
+		resume_connections(ctx);
+
+	/* Once a second, let idle connections expire */
+	if (ctx->expire_scan != current_time) {
+		ctx->expire_scan = current_time;
+		LL_FOREACH(&ctx->connections, lp) {
+			c = LL_ENTRY(lp, struct conn, link);
+			if (current_time > c->expire_time &&
+			    LL_EMPTY(&c->ready_link))
+				LL_TAIL(&ctx->ready, &c->ready_link);
+		}
+	}
+
+	/*
+	 * Take the current ready list, connections that still have work
+	 * after processing put themselves back for the next iteration.
+	 */
+	if (LL_EMPTY(&ctx->ready))
+		return;
+	batch.next = ctx->ready.next;
+	batch.prev = ctx->ready.prev;
+	batch.next->prev = batch.prev->next = &batch;
+	LL_INIT(&ctx->ready);
+
+	LL_FOREACH_SAFE(&batch, lp, tmp) {
+		c = LL_ENTRY(lp, struct conn, ready_link);
+		LL_DEL(&c->ready_link);
+		process_connection(c,
+		    ((c->rem.flags & FLAG_EV_READ) &&
+		     !(c->rem.flags & FLAG_SSL_SHOULD_SELECT_ON_READ)) ||
+		    (c->rem.chan.ssl.ssl && SSL_pending(c->rem.chan.ssl.ssl)) ||
+		    ((c->rem.flags & FLAG_EV_WRITE) &&
+		     (c->rem.flags & FLAG_SSL_SHOULD_SELECT_ON_WRITE)),
+		    c->loc.flags & FLAG_ALWAYS_READY);
+	}
 }
+#endif /* USE_EPOLL */
 
 /*
  * One iteration of server loop. This is the core of the data exchange.
@@ -1105,8 +1491,14 @@ shttpd_poll(struct shttpd_ctx *ctx, int milliseconds)
 	struct conn	*c = NULL;
 	struct timeval	tv;			/* Timeout for select() */
 	fd_set		read_set, write_set;
-	int		sock, max_fd = -1, msec = milliseconds;
-	struct usa	sa;
+	int		max_fd = -1, msec = milliseconds;
+
+#ifdef USE_EPOLL
+	if (ctx->epfd != -1) {
+		poll_epoll(ctx, milliseconds);
+		return;
+	}
+#endif /* USE_EPOLL */
 
 	current_time = time(0);
 	FD_ZERO(&read_set);
@@ -1115,11 +1507,15 @@ shttpd_poll(struct shttpd_ctx *ctx, int milliseconds)
 	/* Add listening sockets to the read set */
 	LL_FOREACH(&listeners, lp) {
 		l = LL_ENTRY(lp, struct listener, link);
+		if (!LISTENS_ON(ctx, l))
+			continue;
 		FD_SET(l->sock, &read_set);
 		if (l->sock > max_fd)
 			max_fd = l->sock;
 		//DBG(("FD_SET(%d) (listening)", l->sock));
 	}
+	if (ctx->wake[0] != -1)
+		add_to_set(ctx->wake[0], &read_set, &max_fd);
 
 	/* Multiplex streams */
 	LL_FOREACH(&ctx->connections, lp) {
@@ -1156,10 +1552,10 @@ shttpd_poll(struct shttpd_ctx *ctx, int milliseconds)
 		 * If there is some data read from local endpoint, check the
 		 * remote socket for write availability
 		 */
-		if (io_data_len(&c->loc.io) && (c->rem.flags &
-			FLAG_SSL_SHOULD_SELECT_ON_READ))
+		if ((io_data_len(&c->loc.io) || c->ext_out_len) &&
+		    (c->rem.flags & FLAG_SSL_SHOULD_SELECT_ON_READ))
 			add_to_set(c->rem.chan.fd, &read_set, &max_fd);
-		else if (io_data_len(&c->loc.io))
+		else if (io_data_len(&c->loc.io) || c->ext_out_len)
 			add_to_set(c->rem.chan.fd, &write_set, &max_fd);
 
 		if (io_space_len(&c->loc.io) && (c->loc.flags & FLAG_R) &&
@@ -1192,31 +1588,15 @@ shttpd_poll(struct shttpd_ctx *ctx, int milliseconds)
 			return;
 	}
 
+	if (ctx->wake[0] == -1 || FD_ISSET(ctx->wake[0], &read_set))
+		resume_connections(ctx);
+
 	/* Check for incoming connections on listener sockets */
 	LL_FOREACH(&listeners, lp) {
 		l = LL_ENTRY(lp, struct listener, link);
-		if (!FD_ISSET(l->sock, &read_set))
+		if (!LISTENS_ON(ctx, l) || !FD_ISSET(l->sock, &read_set))
 			continue;
-		do {
-			sa.len = sizeof(sa.u.sin);
-			if ((sock = accept(l->sock, &sa.u.sa, &sa.len)) != -1) {
-#if defined(_WIN32)
-				shttpd_add_socket(ctx, sock, l->is_ssl);
-#else
-				if (sock >= (int) FD_SETSIZE) {
-					elog(E_LOG, NULL,
-					   "shttpd_poll: ctx %p: disarding "
-					   "socket %d, too busy", ctx, sock);
-					(void) closesocket(sock);
-				} else if (!is_allowed(ctx, &sa)) {
-					//elog(E_LOG, NULL, "shttpd_poll: %s is not allowed to connect",   inet_ntoa(sa.u.sin.sin_addr));
-					(void) closesocket(sock);
-				} else {
-					shttpd_add_socket(ctx, sock, l->is_ssl);
-				}
-#endif /* _WIN32 */
-			}
-		} while (sock != -1);
+		accept_connections(ctx, l);
 	}
 
 	/* Process all connections */
@@ -1305,12 +1685,24 @@ protected_uri_destructor(struct llhead *lp)
 void
 shttpd_fini(struct shttpd_ctx *ctx)
 {
+	struct llhead	*lp, *tmp;
+
+	/* disconnect() must really close, not recycle the connections */
+	LL_FOREACH(&ctx->connections, lp)
+		LL_ENTRY(lp, struct conn, link)->keep_alive = 0;
+
 	free_list(&ctx->mime_types, mime_type_destructor);
 	free_list(&ctx->connections, disconnect);
 	free_list(&ctx->registered_uris, registered_uri_destructor);
  	free_list(&ctx->uri_auths, protected_uri_destructor);
 	free_list(&ctx->acl, acl_destructor);
-	free_list(&listeners, listener_desctructor);
+
+	/* Close the listening sockets of this context only */
+	LL_FOREACH_SAFE(&listeners, lp, tmp)
+		if (LL_ENTRY(lp, struct listener, link)->ctx == ctx) {
+			LL_DEL(lp);
+			listener_desctructor(lp);
+		}
 
 #if !defined(NO_SSI)
 	if (ctx->ssi_extensions)	free(ctx->ssi_extensions);
@@ -1337,6 +1729,14 @@ shttpd_fini(struct shttpd_ctx *ctx)
 	/* TODO: free SSL context */
 	if(ctx->ssl_ctx)
 		SSL_CTX_free(ctx->ssl_ctx);
+#ifdef USE_EPOLL
+	if (ctx->epfd != -1)
+		(void) close(ctx->epfd);
+#endif /* USE_EPOLL */
+	if (ctx->wake[0] != -1) {
+		(void) close(ctx->wake[0]);
+		(void) close(ctx->wake[1]);
+	}
 	free(ctx);
 }
 
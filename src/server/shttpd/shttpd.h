@@ -50,6 +50,8 @@ struct shttpd_arg {
 #define	SHTTPD_MORE_POST_DATA	4
 #define	SHTTPD_POST_BUFFER_FULL	8
 #define	SHTTPD_SSI_EVAL_TRUE	16
+#define	SHTTPD_CLOSE_CONNECTION	32	/* Do not keep connection alive	*/
+#define	SHTTPD_SUSPEND		64	/* Wait for shttpd_wakeup()	*/
 };
 
 /*
@@ -86,6 +88,20 @@ typedef void (*shttpd_callback_t)(struct shttpd_arg *);
  * shttpd_get_env	return string values for the following
  *			pseudo-variables: "REQUEST_METHOD", "REQUEST_URI",
  *			"REMOTE_USER" and "REMOTE_ADDR".
+ * shttpd_keep_alive	return non-zero if the connection stays open after
+ *			the current reply. The callback may set
+ *			SHTTPD_CLOSE_CONNECTION to force a close.
+ * shttpd_suspend	stop calling the callback for this connection until
+ *			shttpd_wakeup() is called with the returned handle.
+ *			Lets the callback hand a request over to another
+ *			thread instead of blocking the poll loop.
+ * shttpd_wakeup	resume a suspended connection. May be called from
+ *			any thread, but not after the callback was called
+ *			with SHTTPD_CONNECTION_ERROR for that connection.
+ * shttpd_set_output	send 'len' bytes from 'buf' after 'out.buf', straight
+ *			to the socket, without copying them. The callback is
+ *			called again once all of it is sent, 'buf' must stay
+ *			valid until then (or SHTTPD_CONNECTION_ERROR).
  */
 
 typedef int (*basic_auth_callback)(char *user, char *passwd);
@@ -110,6 +126,10 @@ const char *shttpd_get_header(struct shttpd_arg *, const char *header_name);
 const char *shttpd_get_env(struct shttpd_arg *, const char *name);
 void shttpd_get_http_version(struct shttpd_arg *,
 		unsigned long *major, unsigned long *minor);
+int shttpd_keep_alive(struct shttpd_arg *);
+void *shttpd_suspend(struct shttpd_arg *);
+void shttpd_wakeup(void *conn);
+void shttpd_set_output(struct shttpd_arg *, const void *buf, size_t len);
 size_t shttpd_printf(struct shttpd_arg *, const char *fmt, ...);
 void shttpd_handle_error(struct shttpd_ctx *ctx, int status,
 		shttpd_callback_t func, void *const data);
@@ -128,6 +148,28 @@ void shttpd_add_socket(struct shttpd_ctx *, int sock, int is_ssl);
 int shttpd_accept(int lsn_sock, int milliseconds);
 int shttpd_active(struct shttpd_ctx *);
 
+/*
+ * Listen on a SO_REUSEPORT socket that only this context accepts on.
+ * Giving each thread its own shard of the port lets the kernel spread
+ * new connections over the threads. Returns -1 if it cannot be opened.
+ */
+int shttpd_listen_shard(struct shttpd_ctx *, int port, int is_ssl);
+
+/*
+ * TLS handshake counters of a context. 'resumed' handshakes reused a
+ * session (from the cache or a ticket), all others were full ones.
+ */
+struct shttpd_ssl_stats {
+	long	handshakes;	/* Completed handshakes			*/
+	long	resumed;	/* ... of which resumed a session	*/
+	long	misses;		/* Session offered but not found	*/
+	long	timeouts;	/* Session offered but expired		*/
+	long	cache_full;	/* Sessions dropped, cache was full	*/
+	long	failed;		/* Handshakes that did not complete	*/
+};
+
+void shttpd_get_ssl_stats(struct shttpd_ctx *, struct shttpd_ssl_stats *);
+
 
 #ifdef __cplusplus
 }
@@ -43,6 +43,8 @@
 #define	DELIM_CHARS	" ,"		/* Separators for lists		*/
 
 #define	EXPIRE_TIME	3600		/* Expiration time, seconds	*/
+#define	KEEP_ALIVE_REQUESTS "0"		/* Max requests per connection	*/
+#define	KEEP_ALIVE_TIMEOUT "15"		/* Keep-alive idle time, seconds */
 #define	ENV_MAX		4096		/* Size of environment block	*/
 #define	CGI_ENV_VARS	64		/* Maximum vars passed to CGI	*/
 #define	URI_MAX		32768		/* Maximum URI size		*/
@@ -50,6 +52,15 @@
 
 #define	NELEMS(ar)	(sizeof(ar) / sizeof(ar[0]))
 
+/*
+ * Use the edge-triggered epoll backend where available. The select()
+ * loop is kept for other platforms, or if NO_EPOLL is defined.
+ */
+#if defined(HAVE_SYS_EPOLL_H) && !defined(NO_EPOLL)
+#define	USE_EPOLL
+#define	EPOLL_EVENTS	256		/* Events fetched per wakeup	*/
+#endif /* HAVE_SYS_EPOLL_H */
+
 #define GLOBAL_DEBUG
 #ifdef GLOBAL_DEBUG
 #ifdef _DEBUG
@@ -256,10 +267,17 @@ struct stream {
 #define	FLAG_SSL_SHOULD_SELECT_ON_WRITE	128	/* ssl should select on write next time  */
 #define	FLAG_SSL_SHOULD_SELECT_ON_READ	256	/*  ssl should select on read next time */
 #define FLAG_RESPONSE_COMPLETE 512
+#define	FLAG_EV_READ		1024		/* epoll: socket readable */
+#define	FLAG_EV_WRITE		2048		/* epoll: socket writable */
+#define	FLAG_SUSPENDED		4096		/* Waits for shttpd_wakeup() */
 };
 
 struct conn {
 	struct llhead	link;		/* Connections chain		*/
+#ifdef USE_EPOLL
+	struct llhead	ready_link;	/* Ready connections chain	*/
+#endif /* USE_EPOLL */
+	struct llhead	wake_link;	/* Woken up connections chain	*/
 	struct shttpd_ctx *ctx;		/* Context this conn belongs to */
 	struct usa	sa;		/* Remote socket address	*/
 	time_t		birth_time;	/* Creation time		*/
@@ -271,6 +289,8 @@ struct conn {
 	char		*uri;		/* Decoded URI			*/
 	unsigned long	major_version;	/* Major HTTP version number    */
 	unsigned long	minor_version;	/* Minor HTTP version number    */
+	unsigned long	nrequests;	/* Requests served on this conn	*/
+	int		keep_alive;	/* Keep open after this request	*/
 	char		*request;	/* Request line			*/
 	char		*headers;	/* Request headers		*/
 	char		*query;		/* QUERY_STRING part of the URI	*/
@@ -281,6 +301,8 @@ struct conn {
 
 	struct stream	loc;		/* Local stream			*/
 	struct stream	rem;		/* Remote stream		*/
+	const char	*ext_out;	/* shttpd_set_output() data	*/
+	size_t		ext_out_len;	/* Bytes of it left to send	*/
 #ifdef SHTTPD_GSS
 	gss_ctx_id_t gss_ctx;    /* GSS context */
 #endif
@@ -301,6 +323,14 @@ struct shttpd_ctx {
 	uint64_t	in, out;	/* IN/OUT traffic counters	*/
 	SSL_CTX		*ssl_ctx;	/* SSL context			*/
 	struct llhead	connections;	/* List of connections		*/
+#ifdef USE_EPOLL
+	int		epfd;		/* epoll descriptor, or -1	*/
+	struct llhead	ready;		/* Connections with work to do	*/
+	int		listeners_gen;	/* Listeners added to epfd	*/
+	time_t		expire_scan;	/* Last expiration scan		*/
+#endif /* USE_EPOLL */
+	struct llhead	woken;		/* Connections to resume	*/
+	int		wake[2];	/* shttpd_wakeup() pipe, or -1	*/
 
 	struct llhead	mime_types;	/* Known mime types		*/
 	struct llhead	registered_uris;/* User urls			*/
@@ -333,11 +363,15 @@ struct shttpd_ctx {
 	int	auto_start;		/* Start on OS boot		*/
 	int	io_buf_size;		/* IO buffer size		*/
 	int	inetd_mode;		/* Inetd flag			*/
+	int	keep_alive_requests;	/* Max requests per connection	*/
+	int	keep_alive_timeout;	/* Keep-alive idle timeout	*/
 #if defined(_WIN32)
 	CRITICAL_SECTION mutex;		/* For MT case			*/
 	HANDLE		ev[2];		/* For thread synchronization */
 #elif defined(__rtems__)
 	rtems_id         mutex;
+#else
+	CRITICAL_SECTION mutex;		/* For MT case			*/
 #endif /* _WIN32 */
 };
 
@@ -469,6 +503,8 @@ extern int	put_dir(const char *path);
 extern void	get_dir(struct conn *c);
 extern void	get_file(struct conn *c, struct stat *stp);
 extern void	ssl_handshake(struct stream *stream);
+extern void	ssl_setup_sessions(SSL_CTX *, int cache_size, int timeout,
+		int ticket_key_lifetime);
 extern void	setup_embedded_stream(struct conn *, union variant, void *);
 extern struct registered_uri *is_registered_uri(struct shttpd_ctx *,
 		const char *uri);
@@ -29,6 +29,19 @@ typedef struct ssl_ctx_st SSL_CTX;
 #define SSL_ERROR_SYSCALL               5
 #define SSL_FILETYPE_PEM	1
 
+#define	SSL_SESS_CACHE_OFF		0x0000
+#define	SSL_SESS_CACHE_SERVER		0x0002
+#define	SSL_CTRL_SESS_ACCEPT		24
+#define	SSL_CTRL_SESS_ACCEPT_GOOD	25
+#define	SSL_CTRL_SESS_HIT		27
+#define	SSL_CTRL_SESS_MISSES		29
+#define	SSL_CTRL_SESS_TIMEOUTS		30
+#define	SSL_CTRL_SESS_CACHE_FULL	31
+#define	SSL_CTRL_SET_SESS_CACHE_SIZE	42
+#define	SSL_CTRL_SET_SESS_CACHE_MODE	44
+#define	SSL_SENT_SHUTDOWN		1
+#define	SSL_RECEIVED_SHUTDOWN		2
+
 #endif
 
 /*
@@ -63,3 +76,10 @@ extern struct ssl_func	ssl_sw[];
 		const char *)) FUNC(15))((x), (y))
 #define	SSL_CTX_free(x)	(*(void (*)(SSL_CTX *)) FUNC(13))(x)
 #define	SSL_pending(x) (*(int (*)(SSL *)) FUNC(14))(x)
+#define	SSL_CTX_ctrl(w,x,y,z)	(*(long (*)(SSL_CTX *, int, long, \
+		void *)) FUNC(16))((w), (x), (y), (z))
+#define	SSL_CTX_set_session_id_context(x,y,z)	(*(int (*)(SSL_CTX *, \
+		const unsigned char *, unsigned int)) FUNC(17))((x), (y), (z))
+#define	SSL_CTX_set_timeout(x,y)	(*(long (*)(SSL_CTX *, long)) \
+		FUNC(18))((x), (y))
+#define	SSL_set_shutdown(x,y)	(*(void (*)(SSL *, int)) FUNC(19))((x), (y))
@@ -0,0 +1,229 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+/**
+ * Admission control.
+ *
+ * Every request dispatched to the workers holds a number of cost units
+ * from the time it is read until its response is ready. Costs depend on
+ * the action, an Enumerate ties up a worker (and a CIMOM connection)
+ * much longer than a Get. Once admission_limit units are in use, or
+ * admission_queue requests are waiting for a worker, further requests are
+ * rejected before they are queued.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "wsman_config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "u/libu.h"
+#include "wsmand-daemon.h"
+#include "wsmand-admission.h"
+
+#define DEFAULT_ADMISSION_COSTS "Enumerate=4 Pull=2 Subscribe=2"
+#define ACTION_SCAN_LIMIT 8192	/* The Action is in the SOAP header */
+#define MAX_ACTION_COSTS 16
+
+typedef struct {
+	char name[64];		/* Last segment of the action URI */
+	int cost;
+} ActionCost;
+
+static pthread_mutex_t admission_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct wsmand_admission_stats admission_stats;
+static ActionCost action_costs[MAX_ACTION_COSTS];
+static int naction_costs = 0;
+static long admission_limit = 0;
+static long admission_queue = 0;
+static unsigned long enum_limit = 0;
+
+
+/* Parse "Name=cost Name=cost ..." */
+static void parse_costs(const char *spec)
+{
+	const char *p = spec;
+	size_t n;
+	ActionCost *ac;
+
+	naction_costs = 0;
+	while (*p && naction_costs < MAX_ACTION_COSTS) {
+		while (*p && (isspace((unsigned char) *p) || *p == ','))
+			p++;
+		n = strcspn(p, "= \t,");
+		if (n == 0 || n >= sizeof(ac->name) || p[n] != '=') {
+			p += n;
+			while (*p && !isspace((unsigned char) *p) && *p != ',')
+				p++;
+			continue;
+		}
+		ac = &action_costs[naction_costs++];
+		memcpy(ac->name, p, n);
+		ac->name[n] = '\0';
+		ac->cost = atoi(p + n + 1);
+		if (ac->cost < 0)
+			ac->cost = 0;
+		p += n + 1;
+		while (*p && !isspace((unsigned char) *p) && *p != ',')
+			p++;
+	}
+}
+
+void wsmand_admission_init(void)
+{
+	char *costs = wsmand_options_get_admission_costs();
+	int max_threads = wsmand_options_get_max_threads();
+
+	parse_costs(costs ? costs : DEFAULT_ADMISSION_COSTS);
+	admission_limit = wsmand_options_get_admission_limit();
+	if (admission_limit < 0)
+		admission_limit = 0;
+	admission_queue = wsmand_options_get_admission_queue();
+	if (admission_queue < 0)
+		admission_queue = 0;
+	if (max_threads > 0)
+		enum_limit = (unsigned long) max_threads *
+		    wsmand_options_get_max_connections_per_thread();
+	debug("admission limit %ld, queue %ld, enumeration contexts limit %lu",
+	      admission_limit, admission_queue, enum_limit);
+}
+
+/*
+ * Find the text of the first Action element, without parsing the
+ * envelope: "<wsa:Action ...>http://.../Name</wsa:Action>".
+ */
+static int find_action(const char *buf, size_t len,
+		       const char **action, size_t *alen)
+{
+	const char *p = buf, *end, *s, *e;
+
+	end = buf + (len < ACTION_SCAN_LIMIT ? len : ACTION_SCAN_LIMIT);
+	while ((p = memchr(p, '<', end - p)) != NULL) {
+		p++;
+		s = p;
+		while (s < end && *s != '>' && *s != ':' && !isspace((unsigned char) *s))
+			s++;
+		if (s < end && *s == ':')
+			p = s + 1;
+		if (end - p < 7 || memcmp(p, "Action", 6) ||
+		    (p[6] != '>' && !isspace((unsigned char) p[6])))
+			continue;
+		if ((s = memchr(p, '>', end - p)) == NULL)
+			return 0;
+		s++;
+		if ((e = memchr(s, '<', end - s)) == NULL)
+			return 0;
+		*action = s;
+		*alen = e - s;
+		return 1;
+	}
+	return 0;
+}
+
+int wsmand_admission_cost(const char *request, size_t len)
+{
+	const char *action, *name;
+	size_t alen, n;
+	int i;
+
+	if (!find_action(request, len, &action, &alen))
+		return 1;
+	while (alen > 0 && isspace((unsigned char) action[alen - 1]))
+		alen--;
+	for (name = action + alen; name > action && name[-1] != '/'; name--);
+	n = action + alen - name;
+	for (i = 0; i < naction_costs; i++) {
+		if (strlen(action_costs[i].name) == n &&
+		    memcmp(action_costs[i].name, name, n) == 0)
+			return action_costs[i].cost;
+	}
+	return 1;
+}
+
+int wsmand_admission_enter(int cost)
+{
+	int r = 0;
+
+	pthread_mutex_lock(&admission_lock);
+	/* A single request is let in even if it is over the limit alone */
+	if ((admission_limit > 0 && cost > 0 &&
+	     admission_stats.inflight > 0 &&
+	     admission_stats.inflight + cost > admission_limit) ||
+	    (admission_queue > 0 &&
+	     admission_stats.queued >= admission_queue)) {
+		admission_stats.rejected++;
+		r = 1;
+	} else {
+		admission_stats.admitted++;
+		admission_stats.inflight += cost;
+		if (admission_stats.inflight > admission_stats.peak)
+			admission_stats.peak = admission_stats.inflight;
+		admission_stats.queued++;
+		if (admission_stats.queued > admission_stats.queue_peak)
+			admission_stats.queue_peak = admission_stats.queued;
+	}
+	pthread_mutex_unlock(&admission_lock);
+	return r;
+}
+
+void wsmand_admission_dequeue(void)
+{
+	pthread_mutex_lock(&admission_lock);
+	admission_stats.queued--;
+	pthread_mutex_unlock(&admission_lock);
+}
+
+void wsmand_admission_leave(int cost)
+{
+	pthread_mutex_lock(&admission_lock);
+	admission_stats.inflight -= cost;
+	pthread_mutex_unlock(&admission_lock);
+}
+
+int wsmand_admission_enum_full(unsigned long contexts)
+{
+	if (enum_limit == 0 || contexts < enum_limit)
+		return 0;
+	pthread_mutex_lock(&admission_lock);
+	admission_stats.enum_rejected++;
+	pthread_mutex_unlock(&admission_lock);
+	return 1;
+}
+
+void wsmand_admission_get_stats(struct wsmand_admission_stats *stats)
+{
+	pthread_mutex_lock(&admission_lock);
+	*stats = admission_stats;
+	pthread_mutex_unlock(&admission_lock);
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+/**
+ * Admission control: bounds the dispatch work the daemon takes on, so
+ * that an overloaded server answers quickly with 503 instead of letting
+ * requests queue up until the clients time out.
+ */
+
+#ifndef WSMAND_ADMISSION_H_
+#define WSMAND_ADMISSION_H_
+
+#include <stddef.h>
+
+struct wsmand_admission_stats {
+	unsigned long admitted;
+	unsigned long rejected;		/* Answered with 503 */
+	unsigned long enum_rejected;	/* Enumerate refused with QuotaLimit */
+	long inflight;			/* Cost units in use */
+	long peak;			/* Most cost units ever in use */
+	long queued;			/* Admitted, waiting for a worker */
+	long queue_peak;		/* Most requests ever waiting */
+};
+
+/* Read the admission options, call before serving requests */
+void wsmand_admission_init(void);
+
+/* Cost of dispatching request, from its wsa:Action */
+int wsmand_admission_cost(const char *request, size_t len);
+
+/*
+ * Take cost units and a queue slot for a request. Returns 0 if it is
+ * admitted, non zero if the server is full and it must be turned away.
+ */
+int wsmand_admission_enter(int cost);
+
+/* Give back the queue slot, a worker has taken the request up */
+void wsmand_admission_dequeue(void);
+
+/* Give back the units of an admitted request */
+void wsmand_admission_leave(int cost);
+
+/*
+ * Called by the Enumerate handler with the number of open enumeration
+ * contexts. Returns non zero if no more may be created.
+ */
+int wsmand_admission_enum_full(unsigned long contexts);
+
+void wsmand_admission_get_stats(struct wsmand_admission_stats *stats);
+
+#endif				/* WSMAND_ADMISSION_H_ */
@@ -96,8 +96,27 @@ static char *basic_authenticator = DEFAULT_BASIC_AUTH;
 static int max_threads = 1;
 static int min_threads = 4;
 static unsigned long enumIdleTimeout = 100;
+static unsigned long msgid_window = 60;
 static char *thread_stack_size="0";
 static int max_connections_per_thread=20;
+static int io_threads = 1;
+static int max_keepalive_requests = 100;
+static int keepalive_timeout = 15;
+static int compression_level = 6;
+static int compression_min_size = 1024;
+static int ssl_session_cache_size = 20480;
+static int ssl_session_timeout = 3600;
+static int ssl_ticket_key_lifetime = 3600;
+static int listener_shards = 0;
+static int admission_limit = 256;
+static int admission_queue = 64;
+static int admission_retry_after = 1;
+static char *admission_costs = NULL;
+static unsigned long enum_context_max_memory = 0;
+static unsigned long enum_max_memory = 0;
+static char *enum_spill_dir = NULL;
+static int enum_prefetch_threads = 0;
+static int enum_prefetch_render = 0;
 
 static char *config_file = NULL;
 
@@ -204,6 +223,25 @@ int wsmand_read_config(dictionary * ini)
 	uri_subscription_repository = iniparser_getstring(ini, "server:subs_repository", DEFAULT_SUBSCRIPTION_REPOSITORY);
         max_connections_per_thread = iniparser_getint(ini, "server:max_connextions_per_thread", 20);
         thread_stack_size = iniparser_getstring(ini, "server:thread_stack_size", "0");
+	max_keepalive_requests = iniparser_getint(ini, "server:max_keepalive_requests", 100);
+	keepalive_timeout = iniparser_getint(ini, "server:keepalive_timeout", 15);
+	io_threads = iniparser_getint(ini, "server:io_threads", 1);
+	compression_level = iniparser_getint(ini, "server:compression_level", 6);
+	compression_min_size = iniparser_getint(ini, "server:compression_min_size", 1024);
+	ssl_session_cache_size = iniparser_getint(ini, "server:ssl_session_cache_size", 20480);
+	ssl_session_timeout = iniparser_getint(ini, "server:ssl_session_timeout", 3600);
+	ssl_ticket_key_lifetime = iniparser_getint(ini, "server:ssl_ticket_key_lifetime", 3600);
+	listener_shards = iniparser_getint(ini, "server:listener_shards", 0);
+	msgid_window = iniparser_getint(ini, "server:msgid_window", 60);
+	admission_limit = iniparser_getint(ini, "server:admission_limit", 256);
+	admission_queue = iniparser_getint(ini, "server:admission_queue", 64);
+	admission_retry_after = iniparser_getint(ini, "server:admission_retry_after", 1);
+	admission_costs = iniparser_getstr(ini, "server:admission_costs");
+	enum_context_max_memory = iniparser_getint(ini, "server:enum_context_max_memory", 0);
+	enum_max_memory = iniparser_getint(ini, "server:enum_max_memory", 0);
+	enum_spill_dir = iniparser_getstr(ini, "server:enum_spill_dir");
+	enum_prefetch_threads = iniparser_getint(ini, "server:enum_prefetch_threads", 0);
+	enum_prefetch_render = iniparser_getboolean(ini, "server:enum_prefetch_render", 0);
 #ifdef ENABLE_EVENTING_SUPPORT
 	wsman_server_set_subscription_repos(uri_subscription_repository);
 #endif
@@ -215,6 +253,101 @@ int wsmand_options_get_max_connections_per_thread(void)
         return max_connections_per_thread;
 }
 
+unsigned long wsmand_options_get_msgid_window(void)
+{
+	return msgid_window;
+}
+
+int wsmand_options_get_io_threads(void)
+{
+	return io_threads;
+}
+
+int wsmand_options_get_listener_shards(void)
+{
+	return listener_shards;
+}
+
+int wsmand_options_get_admission_limit(void)
+{
+	return admission_limit;
+}
+
+int wsmand_options_get_admission_queue(void)
+{
+	return admission_queue;
+}
+
+int wsmand_options_get_admission_retry_after(void)
+{
+	return admission_retry_after;
+}
+
+char *wsmand_options_get_admission_costs(void)
+{
+	return admission_costs;
+}
+
+unsigned long wsmand_options_get_enum_context_max_memory(void)
+{
+	return enum_context_max_memory;
+}
+
+unsigned long wsmand_options_get_enum_max_memory(void)
+{
+	return enum_max_memory;
+}
+
+char *wsmand_options_get_enum_spill_dir(void)
+{
+	return enum_spill_dir;
+}
+
+int wsmand_options_get_enum_prefetch_threads(void)
+{
+	return enum_prefetch_threads;
+}
+
+int wsmand_options_get_enum_prefetch_render(void)
+{
+	return enum_prefetch_render;
+}
+
+int wsmand_options_get_max_keepalive_requests(void)
+{
+	return max_keepalive_requests;
+}
+
+int wsmand_options_get_keepalive_timeout(void)
+{
+	return keepalive_timeout;
+}
+
+int wsmand_options_get_compression_level(void)
+{
+	return compression_level;
+}
+
+int wsmand_options_get_compression_min_size(void)
+{
+	return compression_min_size;
+}
+
+int wsmand_options_get_ssl_session_cache_size(void)
+{
+	return ssl_session_cache_size;
+}
+
+int wsmand_options_get_ssl_session_timeout(void)
+{
+	return ssl_session_timeout;
+}
+
+int wsmand_options_get_ssl_ticket_key_lifetime(void)
+{
+	return ssl_ticket_key_lifetime;
+}
+
 unsigned int wsmand_options_get_thread_stack_size(void)
 {
         errno=0;
@@ -87,6 +87,7 @@ char *wsmand_option_get_basic_authenticator(void);
 char *wsmand_option_get_basic_authenticator_arg(void);
 char *wsmand_options_get_pid_file(void);
 unsigned long wsmand_options_get_enumIdleTimeout(void);
+unsigned long wsmand_options_get_msgid_window(void);
 const char *wsmand_options_get_config_file(void);
 int wsmand_options_get_foreground_debug(void);
 char * wsmand_options_get_subscription_repository_uri(void);
@@ -94,6 +95,24 @@ char *wsmand_options_get_identify_file(void);
 char *wsmand_options_get_anon_identify_file(void);
 unsigned int wsmand_options_get_thread_stack_size(void);
 int wsmand_options_get_max_connections_per_thread(void);
+int wsmand_options_get_io_threads(void);
+int wsmand_options_get_listener_shards(void);
+int wsmand_options_get_admission_limit(void);
+int wsmand_options_get_admission_queue(void);
+int wsmand_options_get_admission_retry_after(void);
+char *wsmand_options_get_admission_costs(void);
+unsigned long wsmand_options_get_enum_context_max_memory(void);
+unsigned long wsmand_options_get_enum_max_memory(void);
+char *wsmand_options_get_enum_spill_dir(void);
+int wsmand_options_get_enum_prefetch_threads(void);
+int wsmand_options_get_enum_prefetch_render(void);
+int wsmand_options_get_max_keepalive_requests(void);
+int wsmand_options_get_keepalive_timeout(void);
+int wsmand_options_get_compression_level(void);
+int wsmand_options_get_compression_min_size(void);
+int wsmand_options_get_ssl_session_cache_size(void);
+int wsmand_options_get_ssl_session_timeout(void);
+int wsmand_options_get_ssl_ticket_key_lifetime(void);
 
 const char **wsmand_options_get_argv(void);
 int wsmand_read_config(dictionary * ini);
@@ -0,0 +1,223 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+/**
+ * Identify response cache.
+ *
+ * Identify is what load balancers and health checks poll, so the answer
+ * is kept in memory. The identify files are checked for changes at most
+ * once a second, the plugin generated responses are kept per charset
+ * until the daemon gets SIGHUP.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "wsman_config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "u/libu.h"
+#include "wsman-soap-envelope.h"
+#include "wsmand-daemon.h"
+#include "wsmand-identify.h"
+
+typedef struct {
+	char *data;
+	size_t len;
+	time_t mtime;
+	off_t size;
+	time_t checked;		/* Last stat() of the file */
+	unsigned int generation;
+} IdentifyFile;
+
+typedef struct _IdentifyResponse {
+	struct _IdentifyResponse *next;
+	char *charset;
+	char *data;
+	size_t len;
+} IdentifyResponse;
+
+static pthread_mutex_t identify_lock = PTHREAD_MUTEX_INITIALIZER;
+static IdentifyFile identify_files[2];
+static IdentifyResponse *identify_responses = NULL;
+static unsigned int responses_generation = 0;
+static volatile sig_atomic_t identify_generation = 1;
+
+
+static int contains(const char *buf, size_t len, const char *word)
+{
+	size_t wlen = strlen(word);
+	const char *p = buf, *end = buf + len;
+
+	while (p && (size_t) (end - p) >= wlen) {
+		if (memcmp(p, word, wlen) == 0)
+			return 1;
+		p = memchr(p + 1, word[0], end - p - 1);
+	}
+	return 0;
+}
+
+int wsmand_identify_request(WsmanMessage *msg)
+{
+	/* The cheap test only works for ASCII compatible encodings */
+	if (msg->charset == NULL || strncasecmp(msg->charset, "UTF-16", 6)) {
+		if (!contains(u_buf_ptr(msg->request),
+			      u_buf_len(msg->request), "Identify"))
+			return 0;
+	}
+	return wsman_check_identify(msg) == 1;
+}
+
+static void drop_file(IdentifyFile *f)
+{
+	u_free(f->data);
+	f->data = NULL;
+	f->len = 0;
+}
+
+/* Called with identify_lock held */
+static void refresh_file(IdentifyFile *f, const char *path)
+{
+	unsigned int generation = identify_generation;
+	time_t now = time(NULL);
+	struct stat st;
+	u_buf_t *buf;
+
+	if (f->generation == generation && f->checked == now)
+		return;
+	f->checked = now;
+	if (stat(path, &st) != 0) {
+		drop_file(f);
+		f->generation = generation;
+		return;
+	}
+	if (f->data && f->generation == generation &&
+	    f->mtime == st.st_mtime && f->size == st.st_size)
+		return;
+
+	drop_file(f);
+	u_buf_create(&buf);
+	if (u_buf_load(buf, (char *) path) == 0) {
+		f->len = u_buf_len(buf);
+		f->data = u_buf_steal(buf);
+		f->mtime = st.st_mtime;
+		f->size = st.st_size;
+		f->generation = generation;
+		debug("loaded identify file %s", path);
+	}
+	u_buf_free(buf);
+}
+
+int wsmand_identify_file_load(int anon, u_buf_t *buf)
+{
+	const char *path = anon ? wsmand_options_get_anon_identify_file() :
+		wsmand_options_get_identify_file();
+	IdentifyFile *f = &identify_files[anon ? 1 : 0];
+	int ret = 1;
+
+	if (path == NULL)
+		return 1;
+	pthread_mutex_lock(&identify_lock);
+	refresh_file(f, path);
+	if (f->data) {
+		u_buf_set(buf, f->data, f->len);
+		ret = 0;
+	}
+	pthread_mutex_unlock(&identify_lock);
+	return ret;
+}
+
+/* Called with identify_lock held */
+static void drop_stale_responses(void)
+{
+	IdentifyResponse *r;
+
+	if (responses_generation == (unsigned int) identify_generation)
+		return;
+	while ((r = identify_responses) != NULL) {
+		identify_responses = r->next;
+		u_free(r->charset);
+		u_free(r->data);
+		u_free(r);
+	}
+	responses_generation = identify_generation;
+}
+
+int wsmand_identify_response_load(const char *charset, u_buf_t *buf)
+{
+	IdentifyResponse *r;
+	int ret = 1;
+
+	pthread_mutex_lock(&identify_lock);
+	drop_stale_responses();
+	for (r = identify_responses; r; r = r->next) {
+		if (strcasecmp(r->charset, charset) == 0) {
+			u_buf_set(buf, r->data, r->len);
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&identify_lock);
+	return ret;
+}
+
+void wsmand_identify_response_store(const char *charset, u_buf_t *buf)
+{
+	IdentifyResponse *r;
+
+	pthread_mutex_lock(&identify_lock);
+	drop_stale_responses();
+	for (r = identify_responses; r; r = r->next) {
+		if (strcasecmp(r->charset, charset) == 0)
+			break;
+	}
+	if (r == NULL) {
+		r = u_zalloc(sizeof(*r));
+		r->charset = u_strdup(charset);
+		r->len = u_buf_len(buf);
+		r->data = u_malloc(r->len);
+		memcpy(r->data, u_buf_ptr(buf), r->len);
+		r->next = identify_responses;
+		identify_responses = r;
+	}
+	pthread_mutex_unlock(&identify_lock);
+}
+
+void wsmand_identify_reload(void)
+{
+	identify_generation++;
+}
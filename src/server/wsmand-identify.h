@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+/**
+ * In memory copies of the wsmid:Identify responses: the identify files
+ * and the response generated by the Identify plugin, so that Identify
+ * requests are answered without reading files or running the dispatcher.
+ */
+
+#ifndef WSMAND_IDENTIFY_H_
+#define WSMAND_IDENTIFY_H_
+
+#include "u/libu.h"
+#include "wsman-soap-message.h"
+
+/*
+ * Returns non zero if msg is a wsmid:Identify request. Requests that can
+ * not be one are rejected without parsing them.
+ */
+int wsmand_identify_request(WsmanMessage *msg);
+
+/*
+ * Load the identify file (anon_identify_file if anon is set) into buf.
+ * The file is reread when its modification time or size changes.
+ * Returns 0 on success, non zero if there is no such file.
+ */
+int wsmand_identify_file_load(int anon, u_buf_t *buf);
+
+/*
+ * Load the cached plugin generated Identify response for charset into
+ * buf. Returns 0 on success, non zero if none was stored yet.
+ */
+int wsmand_identify_response_load(const char *charset, u_buf_t *buf);
+
+/* Remember the plugin generated Identify response for charset */
+void wsmand_identify_response_store(const char *charset, u_buf_t *buf);
+
+/* Drop everything cached. Safe to call from a signal handler. */
+void wsmand_identify_reload(void);
+
+#endif				/* WSMAND_IDENTIFY_H_ */
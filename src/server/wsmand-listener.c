@@ -45,6 +45,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <signal.h>
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -62,6 +63,7 @@
 #include "wsman-xml.h"
 #include "wsman-xml-serializer.h"
 #include "wsman-dispatcher.h"
+#include "wsman-compress.h"
 
 
 #include "shttpd.h"
@@ -70,6 +72,9 @@
 #include "wsman-plugins.h"
 #include "wsmand-listener.h"
 #include "wsmand-daemon.h"
+#include "wsmand-worker.h"
+#include "wsmand-identify.h"
+#include "wsmand-admission.h"
 #include "wsman-server.h"
 #include "wsman-server-api.h"
 #include "wsman-plugins.h"
@@ -84,6 +89,15 @@
 #include <sys/socket.h>
 
 
+/*
+ * Request bodies are preallocated from Content-Length, up to this size.
+ * Larger bodies grow the buffer as the data comes in.
+ */
+#define MAX_REQUEST_PREALLOC (32 * 1024 * 1024)
+
+/* Compressed request bodies may not inflate beyond this size */
+#define MAX_INFLATED_REQUEST (128 * 1024 * 1024)
+
 static pthread_mutex_t shttpd_mutex;
 static pthread_cond_t shttpd_cond;
 int continue_working = 1;
@@ -94,7 +108,26 @@ struct thread {
     struct shttpd_ctx   *ctx;
 };
 
-static struct thread    *threads;   /* List of worker threads */
+static struct thread    *threads;   /* List of I/O threads */
+
+static volatile sig_atomic_t report_stats;	/* Set on SIGUSR1 */
+
+/*
+ * A request handed over to the dispatch workers. It is referenced by
+ * the connection (until the response is picked up, or the connection
+ * breaks) and by the worker running it.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	int refs;
+	int done;		/* Dispatcher finished */
+	int abandoned;		/* Connection is gone, do not wake it up */
+	void *conn;		/* shttpd_suspend() handle, or NULL */
+	int cost;		/* Admission units held while dispatching */
+	SoapH soap;
+	WsmanMessage *msg;
+	WsmanContentCoding coding;	/* Response Content-Encoding */
+} DispatchJob;
 
 typedef struct {
 	char *response;
@@ -139,17 +172,127 @@ char *get_request_encoding(struct shttpd_arg *arg) {
 	return encoding;
 }
 
+static DispatchJob *dispatch_job_new(SoapH soap, WsmanMessage *msg)
+{
+	DispatchJob *job = u_zalloc(sizeof(DispatchJob));
+
+	pthread_mutex_init(&job->lock, NULL);
+	job->refs = 2;
+	job->soap = soap;
+	job->msg = msg;
+	return job;
+}
+
+static void dispatch_job_unref(DispatchJob *job)
+{
+	int refs;
+
+	pthread_mutex_lock(&job->lock);
+	refs = --job->refs;
+	pthread_mutex_unlock(&job->lock);
+	if (refs > 0)
+		return;
+	if (job->msg)
+		wsman_soap_message_destroy(job->msg);
+	pthread_mutex_destroy(&job->lock);
+	u_free(job);
+}
+
+/*
+ * Compress the response if the client asked for it and it is worth
+ * the effort. Leaves job->coding at identity otherwise.
+ */
+static void compress_response(DispatchJob *job)
+{
+	u_buf_t *response = job->msg->response;
+	u_buf_t *out;
+	int level = wsmand_options_get_compression_level();
+
+	if (job->coding == WSMAN_CODING_IDENTITY)
+		return;
+	if (level <= 0 ||
+	    u_buf_len(response) < (size_t) wsmand_options_get_compression_min_size()) {
+		job->coding = WSMAN_CODING_IDENTITY;
+		return;
+	}
+	u_buf_create(&out);
+	if (wsman_deflate(job->coding, level, u_buf_ptr(response),
+			  u_buf_len(response), out) == 0 &&
+	    u_buf_len(out) < u_buf_len(response)) {
+		job->msg->response = out;
+		u_buf_free(response);
+	} else {
+		job->coding = WSMAN_CODING_IDENTITY;
+		u_buf_free(out);
+	}
+}
+
+/* Runs in a dispatch worker, or in the I/O thread if there is no pool */
+static void dispatch_job_run(void *data)
+{
+	DispatchJob *job = data;
+	WsmanMessage *wsman_msg = job->msg;
+
+	wsmand_admission_dequeue();
+	if (wsmand_identify_request(wsman_msg)) {
+		if (wsmand_identify_file_load(0, wsman_msg->response) &&
+		    wsmand_identify_response_load(wsman_msg->charset,
+						  wsman_msg->response)) {
+			dispatch_inbound_call(job->soap, wsman_msg, NULL);
+			if ((wsman_msg->http_code == 0 ||
+			     wsman_msg->http_code == WSMAN_STATUS_OK) &&
+			    !wsman_fault_occured(wsman_msg))
+				wsmand_identify_response_store(wsman_msg->charset,
+							       wsman_msg->response);
+		}
+	} else {
+		dispatch_inbound_call(job->soap, wsman_msg, NULL);
+	}
+	compress_response(job);
+	wsmand_admission_leave(job->cost);
+
+	pthread_mutex_lock(&job->lock);
+	job->done = 1;
+	if (job->conn && !job->abandoned)
+		shttpd_wakeup(job->conn);
+	pthread_mutex_unlock(&job->lock);
+	dispatch_job_unref(job);
+}
+
+static int dispatch_job_done(DispatchJob *job)
+{
+	int done;
+
+	pthread_mutex_lock(&job->lock);
+	done = job->done;
+	pthread_mutex_unlock(&job->lock);
+	return done;
+}
+
+/* The connection broke, the worker must not touch it any more */
+static void dispatch_job_abandon(DispatchJob *job)
+{
+	pthread_mutex_lock(&job->lock);
+	job->abandoned = 1;
+	pthread_mutex_unlock(&job->lock);
+	dispatch_job_unref(job);
+}
+
 static
 void server_callback(struct shttpd_arg *arg)
 {
 	char *encoding = "UTF-8";
 	const char  *s;
 	SoapH soap;
-	int k;
 	int status = WSMAN_STATUS_OK;
+	int rc;
+	int cost;
+	WsmanContentCoding coding;
 	char *request_uri;
 
 	char *fault_reason = NULL;
+	WsmanMessage *wsman_msg;
+	DispatchJob *job;
 	struct state {
         	size_t  cl;     /* Content-Length   */
 	        size_t  nread;      /* Number of bytes read */
@@ -158,33 +301,80 @@ void server_callback(struct shttpd_arg *arg)
 		size_t  len;
 		int     index;
 		int     type;
+		int     error;		/* Status to fail the request with */
+		int     retry_after;	/* Seconds, for a 503 */
+		WsmanInflater *inflater;	/* Content-Encoding of the request */
+		WsmanContentCoding coding;	/* Content-Encoding of the response */
+		DispatchJob *job;	/* Request being dispatched */
+#ifdef SHTTPD_GSS
+		char    *payload;
+#endif
 	} *state;
 
 
 	/* If the connection was broken prematurely, cleanup */
 	if ( (arg->flags & SHTTPD_CONNECTION_ERROR ) && arg->state) {
+		state = arg->state;
+		if (state->job)
+			dispatch_job_abandon(state->job);
+#ifdef SHTTPD_GSS
+		if (state->payload)
+			free(state->payload);
+#endif
+		if (state->request)
+			u_buf_free(state->request);
+		wsman_inflater_free(state->inflater);
+		u_free(state->response);
         	free(arg->state);
 		return;
 	} else if ((s = shttpd_get_header(arg, "Content-Length")) == NULL) {
         	shttpd_printf(arg, "HTTP/1.0 411 Length Required\n\n");
-	        arg->flags |= SHTTPD_END_OF_OUTPUT;
+	        arg->flags |= SHTTPD_END_OF_OUTPUT | SHTTPD_CLOSE_CONNECTION;
 		return;
 	} else if (arg->state == NULL) {
         	/* New request. Allocate a state structure */
         	arg->state = state = calloc(1, sizeof(*state));
 	        state->cl = strtoul(s, NULL, 10);
 		u_buf_create(&(state->request));
+		u_buf_reserve(state->request, state->cl < MAX_REQUEST_PREALLOC ?
+			      state->cl : MAX_REQUEST_PREALLOC);
+		coding = wsman_content_coding(shttpd_get_header(arg,
+							"Content-Encoding"));
+		if (coding != WSMAN_CODING_IDENTITY) {
+			state->inflater = wsman_inflater_new(coding,
+						MAX_INFLATED_REQUEST);
+			if (state->inflater == NULL)
+				state->error = WSMAN_STATUS_UNSUPPORTED_MEDIA_TYPE;
+		}
 	}
 
 	state = arg->state;
 	if ( state->response ) {
 		goto CONTINUE;
 	}
+	if (state->job) {
+		/* Woken up by the dispatch worker */
+		if (!dispatch_job_done(state->job)) {
+			shttpd_suspend(arg);
+			return;
+		}
+		goto DISPATCHED;
+	}
 
-	if (state->nread>0 )
-		u_buf_append(state->request, arg->in.buf, arg->in.len);
-	else
-		u_buf_set(state->request, arg->in.buf, arg->in.len);
+	/*
+	 * Compressed bodies are inflated as they come in. After an error
+	 * the rest of the body is still consumed, so that the connection
+	 * stays usable for the next request.
+	 */
+	if (arg->in.len > 0 && state->error == 0) {
+		if (state->inflater == NULL) {
+			u_buf_append(state->request, arg->in.buf, arg->in.len);
+		} else if ((rc = wsman_inflater_update(state->inflater,
+				arg->in.buf, arg->in.len, state->request)) != 0) {
+			state->error = rc == -2 ? WSMAN_STATUS_REQUEST_ENTITY_TOO_LARGE :
+					WSMAN_STATUS_BAD_REQUEST;
+		}
+	}
 
 	state->nread += arg->in.len;
 	arg->in.num_bytes = arg->in.len;
@@ -193,30 +383,54 @@ void server_callback(struct shttpd_arg *arg)
 	} else {
 		return;
 	}
+	if (state->inflater) {
+		if (state->error == 0 &&
+		    !wsman_inflater_finished(state->inflater))
+			state->error = WSMAN_STATUS_BAD_REQUEST;
+		wsman_inflater_free(state->inflater);
+		state->inflater = NULL;
+	}
 #ifdef SHTTPD_GSS
 	const char *ct = shttpd_get_header(arg, "Content-Type");
 	char *payload = 0; // used for gss encrypt
 
-	if (ct && !memcmp(ct, "multipart/encrypted", 19)) {
+	if (state->error == 0 && ct && !memcmp(ct, "multipart/encrypted", 19)) {
 	        // we have a encrypted payload. decrypt it 
         	payload = gss_decrypt(arg, u_buf_ptr(state->request), u_buf_len(state->request));
 	}
 #endif
+	if (state->error) {
+		status = state->error;
+		goto DONE;
+	}
 	request_uri = (char *)shttpd_get_env(arg, "REQUEST_URI");
 	if (strcmp(request_uri, "/wsman") == 0 ) {
 
+		/* Turn the request away now rather than queue it behind a full pool */
+		cost = wsmand_admission_cost(u_buf_ptr(state->request),
+					     u_buf_len(state->request));
+		if (wsmand_admission_enter(cost)) {
+			status = WSMAN_STATUS_SERVICE_UNAVAILABLE;
+			state->retry_after = wsmand_options_get_admission_retry_after();
+			goto DONE;
+		}
+
 		/* Here we must handle the initial request */
-		WsmanMessage *wsman_msg = wsman_soap_message_new();
+		wsman_msg = wsman_soap_message_new();
 #ifdef SHTTPD_GSS
 	        if(payload == 0) {
 #endif
 			if ( (status = check_request_content_type(arg) ) != WSMAN_STATUS_OK ) {
 				wsman_soap_message_destroy(wsman_msg);
+				wsmand_admission_dequeue();
+				wsmand_admission_leave(cost);
 				goto DONE;
 			}
 			encoding = get_request_encoding(arg);
 
-			u_buf_set(wsman_msg->request, u_buf_ptr(state->request), u_buf_len(state->request));
+			/* The message takes over the request buffer */
+			wsman_soap_message_set_request(wsman_msg, state->request);
+			state->request = NULL;
 #ifdef SHTTPD_GSS
 	        }
 		else {
@@ -234,20 +448,41 @@ void server_callback(struct shttpd_arg *arg)
 		shttpd_get_credentials(arg, &wsman_msg->auth_data.username,
 				&wsman_msg->auth_data.password);
 
-		/* Call dispatcher. Real request handling */
-		if (status == WSMAN_STATUS_OK) {
-			/* dispatch if we didn't find out any error */
-			char *idfile = wsmand_options_get_identify_file();
-			if (idfile && wsman_check_identify(wsman_msg) == 1) {
-				if (u_buf_load(wsman_msg->response, idfile)) {
-					dispatch_inbound_call(soap, wsman_msg, NULL);
-					status = wsman_msg->http_code;
-				}
-			} else {
-				dispatch_inbound_call(soap, wsman_msg, NULL);
-				status = wsman_msg->http_code;
-			}
-		}
+		/*
+		 * Call dispatcher. Real request handling is done by a
+		 * dispatch worker, this connection sleeps until it is done
+		 * so that the I/O thread can serve the other connections.
+		 */
+		job = dispatch_job_new(soap, wsman_msg);
+		job->cost = cost;
+		state->job = job;
+#ifdef SHTTPD_GSS
+		state->payload = payload;
+		if (payload == NULL)
+#endif
+		job->coding = wsman_accept_coding(shttpd_get_header(arg,
+							"Accept-Encoding"));
+		job->conn = shttpd_suspend(arg);
+		if (wsmand_workers_submit(dispatch_job_run, job) == 0)
+			return;
+		arg->flags &= ~SHTTPD_SUSPEND;
+		job->conn = NULL;
+		dispatch_job_run(job);
+
+DISPATCHED:
+		job = state->job;
+		state->job = NULL;
+		wsman_msg = job->msg;
+		job->msg = NULL;
+		state->coding = job->coding;
+		dispatch_job_unref(job);
+		encoding = get_request_encoding(arg);
+#ifdef SHTTPD_GSS
+		payload = state->payload;
+		state->payload = NULL;
+#endif
+		if (wsman_msg->http_code)
+			status = wsman_msg->http_code;
 		if (wsman_msg->request) {
 #ifdef SHTTPD_GSS
 			if (payload) {
@@ -309,6 +544,7 @@ void server_callback(struct shttpd_arg *arg)
 		if (cim_error) {
 			shttpd_printf(arg, "HTTP/1.1 %d %s\r\n", status, fault_reason);
 			shttpd_printf(arg, "CIMError: %s\r\n", cim_error);
+			arg->flags |= SHTTPD_CLOSE_CONNECTION;
 			cimxml_message_destroy(cimxml_msg);
 			goto CONTINUE;
 		}
@@ -320,23 +556,22 @@ void server_callback(struct shttpd_arg *arg)
 #endif
 
 	} else if (strcmp(request_uri, ANON_IDENTIFY_PATH) == 0 ) {
-		char *idfile = wsmand_options_get_anon_identify_file();
 		u_buf_t *id;
 		u_buf_create(&id);
-		if (idfile && u_buf_load(id, idfile) == 0 ) {
+		if (wsmand_identify_file_load(1, id) == 0 ) {
 			state->len =  u_buf_len(id);;
 			state->response = u_buf_steal(id);
 			state->index = 0;
 			u_buf_free(id);
 		} else {
 			shttpd_printf(arg, "HTTP/1.0 404 Not foundn\n");
-			arg->flags |= SHTTPD_END_OF_OUTPUT;
+			arg->flags |= SHTTPD_END_OF_OUTPUT | SHTTPD_CLOSE_CONNECTION;
 			u_buf_free(id);
 			return;
 		}
 	} else {
 		shttpd_printf(arg, "HTTP/1.0 404 Not foundn\n");
-		arg->flags |= SHTTPD_END_OF_OUTPUT;
+		arg->flags |= SHTTPD_END_OF_OUTPUT | SHTTPD_CLOSE_CONNECTION;
 		return;
 	}
 
@@ -375,34 +610,37 @@ DONE:
 		} else {
 			shttpd_printf(arg, "Content-Type: application/soap+xml;charset=%s\r\n", encoding);
 		}
+		if (state->coding != WSMAN_CODING_IDENTITY)
+			shttpd_printf(arg, "Content-Encoding: %s\r\n",
+				      wsman_content_coding_name(state->coding));
     		shttpd_printf(arg, "Content-Length: %d\r\n", state->len);
 #ifdef SHTTPD_GSS
 	}
 #endif
-	shttpd_printf(arg,"Connection: Close\r\n");
-  
+	if (state->retry_after > 0)
+		shttpd_printf(arg, "Retry-After: %d\r\n", state->retry_after);
+	if (shttpd_keep_alive(arg))
+		shttpd_printf(arg, "Connection: Keep-Alive\r\n");
+	else
+		shttpd_printf(arg, "Connection: Close\r\n");
+
         /* separate header from message-body */
 	shttpd_printf(arg, "\r\n");
 
-	/* add response body to output buffer */
+	/*
+	 * shttpd sends the response body straight from our buffer, after
+	 * the headers. We are called again when all of it is gone.
+	 */
 CONTINUE:
-
-
-	k = arg->out.len - arg->out.num_bytes;
-	if (k <= state->len - state->index) {
-		 memcpy(arg->out.buf + arg->out.num_bytes, state->response + state->index, k );
-		 state->index += k ;
-		 arg->out.num_bytes += k;
-		 return;
-	}
-	else {
-	         int l = state->len - state->index;
-		 memcpy(arg->out.buf + arg->out.num_bytes, state->response + state->index, l);
-		 state->index += l ;
-		 arg->out.num_bytes += l;
+	if (state->index < state->len) {
+		shttpd_set_output(arg, state->response + state->index,
+				  state->len - state->index);
+		state->index = state->len;
+		return;
 	}
 
-	u_buf_free(state->request);
+	if (state->request)
+		u_buf_free(state->request);
 	u_free(state->response);
 	u_free(state);
 	arg->flags |= SHTTPD_END_OF_OUTPUT;
@@ -436,6 +674,12 @@ static void protect_uri(struct shttpd_ctx *ctx, char *uri)
 static struct shttpd_ctx *create_shttpd_context(SoapH soap)
 {
 	struct shttpd_ctx *ctx;
+	char ka_requests[16], ka_timeout[16];
+
+	snprintf(ka_requests, sizeof(ka_requests), "%d",
+		 wsmand_options_get_max_keepalive_requests());
+	snprintf(ka_timeout, sizeof(ka_timeout), "%d",
+		 wsmand_options_get_keepalive_timeout());
 	if (wsmand_options_get_use_ssl()) {
 		message("ssl certificate: %s", wsmand_options_get_ssl_cert_file());
 		message("Using SSL");
@@ -444,10 +688,14 @@ static struct shttpd_ctx *create_shttpd_context(SoapH soap)
 				  wsmand_options_get_ssl_cert_file(),
 				  "auth_realm",
 				  AUTHENTICATION_REALM,
+				  "keep_alive_requests", ka_requests,
+				  "keep_alive_timeout", ka_timeout,
 				  NULL);
 	} else {
 		ctx = shttpd_init(NULL,
 				  "auth_realm", AUTHENTICATION_REALM,
+				  "keep_alive_requests", ka_requests,
+				  "keep_alive_timeout", ka_timeout,
 				   NULL);
 	}
 	if (ctx == NULL) {
@@ -598,7 +846,6 @@ static int wsman_setup_thread(pthread_attr_t *pattrs) {
 		debug("pthread_attr_setdetachstate = %d", r);
 		return ret;
 	}
-	return 1;
         size_t thread_stack_size = wsmand_options_get_thread_stack_size();
         if(thread_stack_size){
                 if(( r = pthread_attr_setstacksize(pattrs, thread_stack_size)) !=0) {
@@ -606,6 +853,7 @@ static int wsman_setup_thread(pthread_attr_t *pattrs) {
                         return ret;
                 }
         }
+	return 1;
 }
 
 static void *thread_function(void *param)
@@ -643,25 +891,102 @@ spawn_new_thread(pthread_attr_t pattrs, SoapH soap)
 }
 
 
+/*
+ * SO_REUSEPORT sharding: each I/O thread gets its own listening socket on
+ * the server port and serves the connections it accepts there itself.
+ * All contexts and sockets are set up before any thread runs, shttpd
+ * keeps the listeners on a global list. Returns the number of shards.
+ */
+static int
+spawn_shards(pthread_attr_t pattrs, SoapH soap, int port, int use_ssl,
+		int shards)
+{
+    struct shttpd_ctx   *ctx;
+    struct thread       *thread, *first = threads;
+    pthread_t           tid;
+    int                 n;
+
+    for (n = 0; n < shards; n++) {
+        if ((ctx = create_shttpd_context(soap)) == NULL)
+            break;
+        if (shttpd_listen_shard(ctx, port, use_ssl) == -1) {
+            shttpd_fini(ctx);
+            break;
+        }
+        thread = malloc(sizeof(*thread));
+        assert(thread != NULL);
+        thread->ctx = ctx;
+        thread->next = threads;
+        threads = thread;
+    }
+    if (n < shards)
+        error("Could only open %d of %d listener shards", n, shards);
+
+    for (thread = threads; thread != first; thread = thread->next)
+        pthread_create(&tid, &pattrs, thread_function, thread);
+
+    return n;
+}
+
+
+/*
+ * I/O threads only read requests and write responses, the dispatching
+ * is done by the worker pool. So a new connection simply goes to the
+ * I/O thread with the least connections.
+ */
 static struct thread *
-find_not_busy_thread(int *num_threads, int max_connections_per_thread)
+find_least_busy_thread(void)
 {
-    struct thread   *thread;
+    struct thread   *thread, *best = threads;
 
-    for (thread = threads, *num_threads=0; thread != NULL; thread = thread->next) {
-	debug("Active sockets: %d, Thread Number: %d", shttpd_active(thread->ctx), *num_threads );
-        (*num_threads)++;
-        if (shttpd_active(thread->ctx) < max_connections_per_thread)
-            return (thread);
-	}
+    for (thread = threads; thread != NULL; thread = thread->next) {
+        if (shttpd_active(thread->ctx) < shttpd_active(best->ctx))
+            best = thread;
+    }
 
-    return (NULL);
+    return (best);
 }
 
 
+void wsmand_listener_report_stats(void)
+{
+	report_stats = 1;
+}
+
+static void log_stats(int use_ssl)
+{
+	struct thread *thread;
+	struct shttpd_ssl_stats st, total;
+	struct wsmand_admission_stats as;
+
+	wsmand_admission_get_stats(&as);
+	message("Requests admitted: %lu, rejected: %lu, enumerations "
+		"refused: %lu; cost units in use %ld (peak %ld), "
+		"waiting %ld (peak %ld)",
+		as.admitted, as.rejected, as.enum_rejected,
+		as.inflight, as.peak, as.queued, as.queue_peak);
+	if (!use_ssl)
+		return;
+	memset(&total, 0, sizeof(total));
+	for (thread = threads; thread != NULL; thread = thread->next) {
+		shttpd_get_ssl_stats(thread->ctx, &st);
+		total.handshakes += st.handshakes;
+		total.resumed += st.resumed;
+		total.misses += st.misses;
+		total.timeouts += st.timeouts;
+		total.cache_full += st.cache_full;
+		total.failed += st.failed;
+	}
+	message("TLS handshakes: %ld (%ld resumed, %ld full, %ld failed); "
+		"session misses %ld, timeouts %ld, cache full %ld",
+		total.handshakes, total.resumed,
+		total.handshakes - total.resumed, total.failed,
+		total.misses, total.timeouts, total.cache_full);
+}
+
 WsManListenerH *wsmand_start_server(dictionary * ini)
 {
-	int lsn, port, sock;
+	int lsn = -1, port, sock;
 	struct thread       *thread;
 	pthread_t tid;
 #ifdef ENABLE_EVENTING_SUPPORT
@@ -674,11 +999,13 @@ WsManListenerH *wsmand_start_server(dictionary * ini)
 	WsManListenerH *listener = wsman_dispatch_list_new();
 	listener->config = ini;
 	WsContextH cntx = wsman_init_plugins(listener);
-        int num_threads=0;
-        int max_threads=wsmand_options_get_max_threads();
-        int max_connections_per_thread = wsmand_options_get_max_connections_per_thread();
-        if(max_threads && !max_connections_per_thread){
-                error("max_threads: %d and max_connections_per_thread : %d", max_threads, max_connections_per_thread);
+        int i;
+        int io_threads = wsmand_options_get_io_threads();
+        int shards = wsmand_options_get_listener_shards();
+        int min_threads = wsmand_options_get_min_threads();
+        int max_threads = wsmand_options_get_max_threads();
+        if (max_threads && max_threads < min_threads) {
+                error("max_threads: %d is less than min_threads: %d", max_threads, min_threads);
                 return listener;
         }
 
@@ -697,6 +1024,14 @@ WsManListenerH *wsmand_start_server(dictionary * ini)
 #endif
 	SoapH soap = ws_context_get_runtime(cntx);
 	ws_set_context_enumIdleTimeout(cntx,wsmand_options_get_enumIdleTimeout());
+	ws_set_context_msgIdWindow(cntx, wsmand_options_get_msgid_window());
+	ws_set_context_enumMemoryLimits(cntx,
+			wsmand_options_get_enum_context_max_memory() * 1024,
+			wsmand_options_get_enum_max_memory() * 1024,
+			wsmand_options_get_enum_spill_dir());
+	ws_set_context_enumPrefetch(cntx,
+			wsmand_options_get_enum_prefetch_threads(),
+			wsmand_options_get_enum_prefetch_render());
 
 
 	if ((port = get_server_port()) == 0  )
@@ -717,36 +1052,49 @@ WsManListenerH *wsmand_start_server(dictionary * ini)
 	wsmand_shutdown_add_handler(listener_shutdown_handler,
 				    &continue_working);
 
-	httpd_ctx = create_shttpd_context(soap);
-
-	lsn = shttpd_listen(httpd_ctx, port, use_ssl);
-
 	if (wsman_setup_thread(&pattrs) == 0 )
 		return listener;
 	pthread_create(&tid, &pattrs, wsman_server_auxiliary_loop_thread, cntx);
 
+	wsmand_admission_init();
+	if (wsmand_workers_start(min_threads, max_threads, &pattrs) != 0)
+		error("Could not start dispatch workers, dispatching in I/O threads");
+
+	if (shards > 0) {
+		shards = spawn_shards(pattrs, soap, port, use_ssl, shards);
+		if (shards > 0)
+			message("Accepting on %d listener shards", shards);
+		else
+			error("SO_REUSEPORT listeners not available, using a single acceptor");
+	}
+	if (shards <= 0) {
+		httpd_ctx = create_shttpd_context(soap);
+		lsn = shttpd_listen(httpd_ctx, port, use_ssl);
+		if (io_threads < 1)
+			io_threads = 1;
+		for (i = 0; i < io_threads; i++)
+			spawn_new_thread(pattrs, soap);
+	}
+
 #ifdef ENABLE_EVENTING_SUPPORT
 	pthread_create(&notificationManager_id, &pattrs, wsman_notification_manager, cntx);
 #endif
 
 	while (continue_working) {
+		if (report_stats) {
+			report_stats = 0;
+			log_stats(use_ssl);
+		}
+		if (shards > 0) {
+			/* The shards accept on their own */
+			sleep(1);
+			continue;
+		}
 		if ((sock = shttpd_accept(lsn, 1000)) == -1) {
 			continue;
 		}
 		debug("Sock %d accepted", sock);
-                if ((thread = find_not_busy_thread(&num_threads, max_connections_per_thread)) == NULL){
-                        if(max_threads){
-                                if(num_threads < max_threads){
-                                        thread = spawn_new_thread(pattrs, soap);
-                                }
-                                else{
-                                        continue;
-                                }
-                        }
-                        else{
-                                thread = spawn_new_thread(pattrs, soap);
-                        }
-		}
+		thread = find_least_busy_thread();
                 shttpd_add_socket(thread->ctx, sock, use_ssl);
         }
         return listener;
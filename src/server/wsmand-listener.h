@@ -40,4 +40,7 @@
 
 WsManListenerH *wsmand_start_server(dictionary * ini);
 
+/* Log the server counters; safe to call from a signal handler */
+void wsmand_listener_report_stats(void);
+
 #endif				/*SERVER_H_ */
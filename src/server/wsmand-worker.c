@@ -0,0 +1,242 @@
+/*******************************************************************************
+ * Copyright (C) 2004-2006 Intel Corp. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of Intel Corp. nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL Intel Corp. OR THE CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+/**
+ * Dispatch worker pool.
+ *
+ * Every worker owns a run queue. Work is spread over the queues round
+ * robin, a worker whose queue is empty steals from the others before it
+ * goes to sleep, so one long running request (e.g. a big enumeration)
+ * never holds up requests queued behind it while other workers idle.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "wsman_config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "u/libu.h"
+#include "wsmand-worker.h"
+
+#define WORKER_QUEUE_SIZE 16	/* Initial run queue size, power of 2 */
+
+typedef struct {
+	WsmandWorkFn fn;
+	void *data;
+} WorkItem;
+
+typedef struct {
+	pthread_mutex_t lock;
+	WorkItem *items;
+	unsigned int size;	/* Allocated items, power of 2 */
+	unsigned int head;	/* Oldest item */
+	unsigned int count;	/* Queued items */
+} WorkQueue;
+
+typedef struct {
+	pthread_mutex_t lock;	/* Protects all fields below */
+	pthread_cond_t cond;	/* Signalled when work is queued */
+	pthread_attr_t attrs;
+	WorkQueue *queues;	/* One per worker, max_workers */
+	int max_workers;
+	int nworkers;		/* Started workers, never shrinks */
+	int nidle;		/* Workers waiting for work */
+	unsigned long pending;	/* Queued, not yet claimed items */
+	unsigned int next;	/* Round robin queue index */
+} WorkerPool;
+
+static WorkerPool *pool = NULL;
+
+static int queue_push(WorkQueue *q, WsmandWorkFn fn, void *data)
+{
+	WorkItem *item;
+	unsigned int i;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->count == q->size) {
+		WorkItem *items = u_malloc(2 * q->size * sizeof(*items));
+		if (items == NULL) {
+			pthread_mutex_unlock(&q->lock);
+			return 1;
+		}
+		for (i = 0; i < q->count; i++)
+			items[i] = q->items[(q->head + i) & (q->size - 1)];
+		u_free(q->items);
+		q->items = items;
+		q->head = 0;
+		q->size *= 2;
+	}
+	item = &q->items[(q->head + q->count) & (q->size - 1)];
+	item->fn = fn;
+	item->data = data;
+	q->count++;
+	pthread_mutex_unlock(&q->lock);
+	return 0;
+}
+
+/*
+ * The owner and thieves both take the oldest item: requests are
+ * independent, so first come first served keeps the latency fair.
+ */
+static int queue_pop(WorkQueue *q, WorkItem *item)
+{
+	int found = 0;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->count > 0) {
+		*item = q->items[q->head];
+		q->head = (q->head + 1) & (q->size - 1);
+		q->count--;
+		found = 1;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return found;
+}
+
+/* Take an item from our own queue, or steal one from the first n */
+static int get_work(int id, int n, WorkItem *item)
+{
+	int i;
+
+	if (queue_pop(&pool->queues[id], item))
+		return 1;
+	for (i = 1; i < n; i++) {
+		if (queue_pop(&pool->queues[(id + i) % n], item))
+			return 1;
+	}
+	return 0;
+}
+
+static void *worker_function(void *param)
+{
+	int id = (int) (long) param;
+	WorkItem item;
+	int n;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->pending == 0) {
+			pool->nidle++;
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			pool->nidle--;
+		}
+		/*
+		 * Claim one of the queued items. There are always at least
+		 * as many items in the queues as claims not yet served, so
+		 * the search only repeats when a worker that claimed later
+		 * took the one we saw, and another was queued meanwhile.
+		 */
+		pool->pending--;
+		n = pool->nworkers;
+		pthread_mutex_unlock(&pool->lock);
+		while (!get_work(id, n, &item)) {
+			pthread_mutex_lock(&pool->lock);
+			n = pool->nworkers;
+			pthread_mutex_unlock(&pool->lock);
+		}
+		item.fn(item.data);
+	}
+	return NULL;
+}
+
+/* Called with pool->lock held */
+static int spawn_worker(void)
+{
+	pthread_t tid;
+	int r;
+
+	if ((r = pthread_create(&tid, &pool->attrs, worker_function,
+				(void *) (long) pool->nworkers)) != 0) {
+		error("pthread_create failed = %d", r);
+		return 1;
+	}
+	pool->nworkers++;
+	debug("started dispatch worker %d", pool->nworkers);
+	return 0;
+}
+
+int wsmand_workers_start(int min_workers, int max_workers,
+			 pthread_attr_t *pattrs)
+{
+	int i;
+
+	if (pool != NULL)
+		return 0;
+	if (min_workers < 1)
+		min_workers = 1;
+	if (max_workers < min_workers)
+		max_workers = min_workers;
+
+	pool = u_zalloc(sizeof(*pool));
+	pool->queues = u_zalloc(max_workers * sizeof(WorkQueue));
+	for (i = 0; i < max_workers; i++) {
+		pthread_mutex_init(&pool->queues[i].lock, NULL);
+		pool->queues[i].size = WORKER_QUEUE_SIZE;
+		pool->queues[i].items =
+		    u_malloc(WORKER_QUEUE_SIZE * sizeof(WorkItem));
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->attrs = *pattrs;
+	pool->max_workers = max_workers;
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < min_workers; i++) {
+		if (spawn_worker())
+			break;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	message("Dispatch workers: %d (max %d)", pool->nworkers, max_workers);
+
+	return pool->nworkers == 0;
+}
+
+int wsmand_workers_submit(WsmandWorkFn fn, void *data)
+{
+	int r = 1;
+
+	if (pool == NULL)
+		return 1;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->nworkers > 0 &&
+	    queue_push(&pool->queues[pool->next++ % pool->nworkers],
+		       fn, data) == 0) {
+		pool->pending++;
+		if (pool->nidle == 0 && pool->nworkers < pool->max_workers)
+			spawn_worker();
+		pthread_cond_signal(&pool->cond);
+		r = 0;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return r;
+}
@@ -69,6 +69,7 @@
 #include "wsman-plugins.h"
 #include "wsmand-listener.h"
 #include "wsmand-daemon.h"
+#include "wsmand-identify.h"
 
 
 static int log_pid = 0;
@@ -139,9 +140,16 @@ static void signal_handler(int sig_num)
 
 
 
+static void sigusr1_handler(int sig_num)
+{
+	wsmand_listener_report_stats();
+}
+
+
 static void sighup_handler(int sig_num)
 {
 	debug("SIGHUP received; reloading data");
+	wsmand_identify_reload();
 
 	if (wsmand_options_get_debug_level() == 0) {
 		int fd;
@@ -290,6 +298,12 @@ int main(int argc, char **argv)
 	sig_action.sa_flags = 0;
 	sigaction(SIGHUP, &sig_action, NULL);
 
+	/* Set up SIGUSR1 handler. */
+	sig_action.sa_handler = sigusr1_handler;
+	sigemptyset(&sig_action.sa_mask);
+	sig_action.sa_flags = 0;
+	sigaction(SIGUSR1, &sig_action, NULL);
+
 	initialize_logging();
 	
 	listener = wsmand_start_server(ini);
@@ -0,0 +1,136 @@
+/*
+ * The I/O thread must sleep in epoll_wait() while the request of a
+ * connection is suspended, i.e. being handled by a dispatch worker.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "shttpd.h"
+#include "u/libu.h"
+#include "wsmand-daemon.h"
+
+#define BODY "<s:Envelope/>"
+#define POLL_MSEC 100
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static void *suspended = NULL;
+static volatile int stop = 0;
+static volatile unsigned long polls = 0;
+
+/* The daemon options shttpd reads, plain HTTP over IPv4 */
+int wsmand_options_get_use_ipv4(void) { return 1; }
+int wsmand_options_get_use_ipv6(void) { return 0; }
+void wsmand_options_disable_use_ipv6(void) { }
+char *wsmand_options_get_ssl_key_file(void) { return NULL; }
+char *wsmand_options_get_ssl_cert_file(void) { return NULL; }
+int wsmand_options_get_ssl_session_cache_size(void) { return 0; }
+int wsmand_options_get_ssl_session_timeout(void) { return 0; }
+int wsmand_options_get_ssl_ticket_key_lifetime(void) { return 0; }
+
+static void callback(struct shttpd_arg *arg)
+{
+	if (arg->state == NULL) {
+		if (arg->flags & SHTTPD_MORE_POST_DATA)
+			return;
+		arg->in.num_bytes = arg->in.len;
+		arg->state = arg;
+		pthread_mutex_lock(&lock);
+		suspended = shttpd_suspend(arg);
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	shttpd_printf(arg, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+	arg->flags |= SHTTPD_END_OF_OUTPUT;
+}
+
+static void *poller(void *data)
+{
+	struct shttpd_ctx *ctx = data;
+
+	while (!stop) {
+		shttpd_poll(ctx, POLL_MSEC);
+		polls++;
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	struct shttpd_ctx *ctx;
+	struct sockaddr_in sa;
+	pthread_t thread;
+	char req[512], resp[512];
+	unsigned long before;
+	int port, sock, n, len = 0, failed = 0;
+	void *conn = NULL;
+
+	ctx = shttpd_init(NULL, NULL);
+	if (ctx == NULL) {
+		printf("shttpd_init failed\n");
+		return 1;
+	}
+	shttpd_register_uri(ctx, "/wsman", callback, NULL);
+	for (port = 17385; port < 17485; port++)
+		if (shttpd_listen(ctx, port, 0) != -1)
+			break;
+	pthread_create(&thread, NULL, poller, ctx);
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(sock, (struct sockaddr *) &sa, sizeof(sa))) {
+		printf("connect to port %d failed\n", port);
+		return 1;
+	}
+	n = snprintf(req, sizeof(req), "POST /wsman HTTP/1.1\r\n"
+		     "Host: localhost\r\nContent-Length: %d\r\n\r\n%s",
+		     (int) strlen(BODY), BODY);
+	write(sock, req, n);
+
+	for (n = 0; conn == NULL && n < 100; n++) {
+		usleep(10000);
+		pthread_mutex_lock(&lock);
+		conn = suspended;
+		pthread_mutex_unlock(&lock);
+	}
+	if (conn == NULL) {
+		printf("request was not suspended\n");
+		return 1;
+	}
+
+	/* About ten polls in a second if idle, a spinning loop does millions */
+	before = polls;
+	sleep(1);
+	if (polls - before > 3 * 1000 / POLL_MSEC) {
+		printf("%lu polls in a second while suspended\n",
+		       polls - before);
+		failed = 1;
+	}
+
+	shttpd_wakeup(conn);
+	while (len < (int) sizeof(resp) - 1 &&
+	       (n = read(sock, resp + len, sizeof(resp) - 1 - len)) > 0) {
+		len += n;
+		resp[len] = '\0';
+		if (strstr(resp, "\r\n\r\nok"))
+			break;
+	}
+	resp[len] = '\0';
+	if (strstr(resp, "\r\n\r\nok") == NULL) {
+		printf("no response after wakeup: %s\n", resp);
+		failed = 1;
+	}
+	close(sock);
+	stop = 1;
+	pthread_join(thread, NULL);
+	printf("%s\n", failed ? "failed" : "ok");
+	return failed;
+}
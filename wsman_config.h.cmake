@@ -139,6 +139,11 @@
 #define HAVE_LIBCRYPT 1
 #endif
 
+/* Define to 1 if you have zlib (gzip/deflate Content-Encoding). */
+#if @HAVE_ZLIB@
+#define HAVE_ZLIB 1
+#endif
+
 /* Define to 1 if you have the `nsl' library (-lnsl). */
 #if @HAVE_LIBNSL@
 #define HAVE_LIBNSL 1
@@ -269,6 +274,11 @@
 #define HAVE_SYSLOG 1
 #endif
 
+/* Define to 1 if you have the <sys/epoll.h> header file. */
+#if @HAVE_SYS_EPOLL_H@
+#define HAVE_SYS_EPOLL_H 1
+#endif
+
 /* Define to 1 if you have the <sys/ioctl.h> header file. */
 #if @HAVE_SYS_IOCTL_H@
 #define HAVE_SYS_IOCTL_H 1